@@ -0,0 +1,414 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2022 Sanpe <sanpeqf@gmail.com>
+ */
+
+#define EXAMPLE_ALLOC_COUNT
+#include "example.h"
+#include <unistd.h>
+#include <malloc.h>
+
+#ifndef BENCH_VERSION
+# define BENCH_VERSION "unknown"
+#endif
+
+#define BENCH_SEED      0x4c4a534eU
+#define BENCH_MIN_LOOPS 3
+#define BENCH_MIN_NSEC  200000000ULL
+#define BENCH_MAX_NSEC  2000000000ULL
+
+static unsigned int bench_seed;
+
+static unsigned int bench_rand(void)
+{
+    bench_seed = bench_seed * 1103515245U + 12345U;
+    return bench_seed >> 8;
+}
+
+static void corpus_deep(struct example_buff *buff, unsigned int scale)
+{
+    unsigned int count, depth;
+
+    buff_printf(buff, "[");
+    for (count = 0; count < scale * 200; ++count) {
+        buff_printf(buff, count ? "," : "");
+        for (depth = 0; depth < 24; ++depth)
+            buff_printf(buff, depth & 1 ? "{\"d%u\":" : "[", depth);
+        buff_printf(buff, "%u", bench_rand() % 1000);
+        for (depth = 24; depth--;)
+            buff_printf(buff, depth & 1 ? "}" : "]");
+    }
+    buff_printf(buff, "]");
+}
+
+static void corpus_wide(struct example_buff *buff, unsigned int scale)
+{
+    unsigned int count;
+
+    buff_printf(buff, "{");
+    for (count = 0; count < scale * 20000; ++count)
+        buff_printf(buff, "%s\"key%08x\": %u", count ? ", " : "", bench_rand(), bench_rand() % 100000);
+    buff_printf(buff, "}");
+}
+
+static void corpus_numbers(struct example_buff *buff, unsigned int scale)
+{
+    unsigned int count;
+
+    buff_printf(buff, "[");
+    for (count = 0; count < scale * 50000; ++count)
+        buff_printf(buff, "%s%u", count ? "," : "", bench_rand());
+    buff_printf(buff, "]");
+}
+
+static void corpus_strings(struct example_buff *buff, unsigned int scale)
+{
+    unsigned int count, index;
+
+    buff_printf(buff, "[");
+    for (count = 0; count < scale * 100; ++count) {
+        buff_printf(buff, "%s\"", count ? "," : "");
+        for (index = 0; index < 4096; ++index) {
+            if (bench_rand() % 512)
+                buff_printf(buff, "%c", 'a' + bench_rand() % 26);
+            else
+                buff_printf(buff, "\\n");
+        }
+        buff_printf(buff, "\"");
+    }
+    buff_printf(buff, "]");
+}
+
+static void corpus_ndjson(struct example_buff *buff, unsigned int scale)
+{
+    unsigned int count;
+
+    for (count = 0; count < scale * 5000; ++count) {
+        buff_printf(buff, "{\"seq\": %u, \"level\": \"%s\", \"msg\": \"request %08x done\","
+                    " \"tags\": [\"a\", \"b\"], \"ok\": %s, \"extra\": null}\n",
+                    count, bench_rand() & 1 ? "info" : "warn", bench_rand(),
+                    bench_rand() & 1 ? "true" : "false");
+    }
+}
+
+static const struct bench_corpus {
+    const char *name;
+    void (*generate)(struct example_buff *buff, unsigned int scale);
+    bool ndjson;
+} bench_corpus[] = {
+    {"deep",    corpus_deep,    false},
+    {"wide",    corpus_wide,    false},
+    {"numbers", corpus_numbers, false},
+    {"strings", corpus_strings, false},
+    {"ndjson",  corpus_ndjson,  true},
+};
+
+struct bench_docs {
+    struct json_node **roots;
+    unsigned int count, size;
+};
+
+static long status_kb(const char *key)
+{
+    size_t length = strlen(key);
+    char line[128];
+    long value = -1;
+    FILE *file;
+
+    file = fopen("/proc/self/status", "r");
+    if (!file)
+        return -1;
+
+    while (fgets(line, sizeof(line), file)) {
+        if (!strncmp(line, key, length) && line[length] == ':') {
+            value = strtol(line + length + 1, NULL, 10);
+            break;
+        }
+    }
+
+    fclose(file);
+    return value;
+}
+
+/*
+ * Hand freed heap back first so an op is not credited with memory an earlier
+ * one left behind, then reset VmHWM to the current RSS (Linux clear_refs).
+ */
+static void rss_reset(void)
+{
+    FILE *file;
+
+    malloc_trim(0);
+
+    file = fopen("/proc/self/clear_refs", "w");
+    if (!file)
+        return;
+
+    fputs("5", file);
+    fclose(file);
+}
+
+static unsigned long count_nodes(struct json_node *root)
+{
+    struct json_node *child;
+    unsigned long count = 1;
+
+    if (json_test_array(root) || json_test_object(root)) {
+        list_for_each_entry(child, &root->child, sibling)
+            count += count_nodes(child);
+    }
+
+    return count;
+}
+
+static int docs_append(struct bench_docs *docs, struct json_node *root)
+{
+    if (docs->count == docs->size) {
+        docs->size = docs->size ? docs->size * 2 : 16;
+        docs->roots = realloc(docs->roots, docs->size * sizeof(*docs->roots));
+        if (!docs->roots) {
+            json_release(root);
+            return -ENOMEM;
+        }
+    }
+
+    docs->roots[docs->count++] = root;
+    return 0;
+}
+
+static int docs_parse(const struct bench_corpus *corpus, const char *text, struct bench_docs *docs)
+{
+    struct json_parser *parser;
+    struct json_node *root;
+    const char *walk, *line;
+    size_t length;
+    ssize_t retval = 0;
+
+    docs->count = 0;
+    if (!corpus->ndjson) {
+        retval = json_parse(text, &root);
+        return retval ? retval : docs_append(docs, root);
+    }
+
+    parser = json_parser_create(NULL);
+    if (!parser)
+        return -ENOMEM;
+
+    /* one document per line, each fed with its own bounds */
+    for (walk = text; *walk && !retval; walk += length + !!line) {
+        line = strchr(walk, '\n');
+        length = line ? (size_t)(line - walk) : strlen(walk);
+        if (!length)
+            continue;
+
+        retval = json_parser_feed(parser, walk, length);
+        if (retval >= 0)
+            retval = json_parser_finish(parser, &root);
+        if (!retval)
+            retval = docs_append(docs, root);
+    }
+
+    json_parser_destroy(parser);
+    return retval;
+}
+
+static void docs_release(struct bench_docs *docs)
+{
+    unsigned int count;
+
+    for (count = 0; count < docs->count; ++count)
+        json_release(docs->roots[count]);
+    docs->count = 0;
+}
+
+static size_t docs_encode(struct bench_docs *docs, char *buff, size_t size)
+{
+    unsigned int count;
+    size_t total = 0;
+
+    for (count = 0; count < docs->count; ++count)
+        total += json_encode(docs->roots[count], buff, size);
+
+    return total;
+}
+
+struct bench_result {
+    unsigned long long nsec;
+    unsigned long long allocs;
+    unsigned long long alloc_bytes;
+    unsigned int loops;
+    unsigned long long start, count, bytes, wall;
+    long rss_base;
+};
+
+static void bench_reset(struct bench_result *result)
+{
+    memset(result, 0, sizeof(*result));
+    rss_reset();
+    result->rss_base = status_kb("VmRSS");
+    result->wall = time_ns();
+}
+
+/* ops timed apart from their setup may stop on wall clock instead */
+static bool bench_more(struct bench_result *result)
+{
+    if (result->loops < BENCH_MIN_LOOPS)
+        return true;
+
+    return result->nsec < BENCH_MIN_NSEC && time_ns() - result->wall < BENCH_MAX_NSEC;
+}
+
+static void bench_start(struct bench_result *result)
+{
+    result->count = example_alloc.count;
+    result->bytes = example_alloc.bytes;
+    result->start = time_ns();
+}
+
+static void bench_stop(struct bench_result *result)
+{
+    result->nsec += time_ns() - result->start;
+    result->allocs += example_alloc.count - result->count;
+    result->alloc_bytes += example_alloc.bytes - result->bytes;
+    result->loops++;
+}
+
+static void bench_report(bool machine, const char *corpus, const char *op, size_t bytes,
+                         unsigned long nodes, struct bench_result *result)
+{
+    double sec = result->nsec / 1e9 / result->loops;
+    long peak, growth;
+
+    /* peak since bench_reset(), and how far it rose above the RSS there */
+    peak = status_kb("VmHWM");
+    growth = peak >= 0 && result->rss_base >= 0 ? peak - result->rss_base : -1;
+
+    if (machine) {
+        printf("{\"version\": \"%s\", \"corpus\": \"%s\", \"op\": \"%s\", \"bytes\": %zu, "
+               "\"nodes\": %lu, \"loops\": %u, \"ns_per_op\": %.0f, \"mb_per_s\": %.2f, "
+               "\"nodes_per_s\": %.0f, \"allocs_per_op\": %.1f, \"alloc_bytes_per_op\": %.0f, "
+               "\"peak_rss_kb\": %ld, \"rss_growth_kb\": %ld}\n", BENCH_VERSION, corpus, op,
+               bytes, nodes, result->loops, sec * 1e9, bytes / sec / 1e6, nodes / sec,
+               (double)result->allocs / result->loops,
+               (double)result->alloc_bytes / result->loops, peak, growth);
+        return;
+    }
+
+    printf("%-8s %-8s %10.2f MB/s %12.0f nodes/s %12.1f allocs %14.0f bytes %8ld KB rss %+8ld KB\n",
+           corpus, op, bytes / sec / 1e6, nodes / sec,
+           (double)result->allocs / result->loops,
+           (double)result->alloc_bytes / result->loops, peak, growth);
+}
+
+static int bench_run(const struct bench_corpus *corpus, unsigned int scale, bool machine)
+{
+    struct example_buff text = {};
+    struct bench_docs docs = {};
+    struct bench_result result;
+    unsigned long nodes = 0;
+    unsigned int count;
+    size_t encoded;
+    char *output;
+    int retval;
+
+    bench_seed = BENCH_SEED;
+    corpus->generate(&text, scale);
+
+    retval = docs_parse(corpus, text.data, &docs);
+    if (retval)
+        goto finish;
+
+    for (count = 0; count < docs.count; ++count)
+        nodes += count_nodes(docs.roots[count]);
+
+    encoded = docs_encode(&docs, NULL, 0);
+    output = malloc(encoded);
+    if (!output) {
+        retval = -ENOMEM;
+        goto finish;
+    }
+
+    for (bench_reset(&result); bench_more(&result);) {
+        bench_start(&result);
+        docs_encode(&docs, output, encoded);
+        bench_stop(&result);
+    }
+    bench_report(machine, corpus->name, "encode", encoded, nodes, &result);
+    free(output);
+    docs_release(&docs);
+
+    for (bench_reset(&result); bench_more(&result);) {
+        bench_start(&result);
+        retval = docs_parse(corpus, text.data, &docs);
+        bench_stop(&result);
+        if (retval)
+            goto finish;
+        docs_release(&docs);
+    }
+    bench_report(machine, corpus->name, "parse", text.len, nodes, &result);
+
+    for (bench_reset(&result); bench_more(&result);) {
+        retval = docs_parse(corpus, text.data, &docs);
+        if (retval)
+            goto finish;
+        bench_start(&result);
+        docs_release(&docs);
+        bench_stop(&result);
+    }
+    bench_report(machine, corpus->name, "release", text.len, nodes, &result);
+
+finish:
+    docs_release(&docs);
+    json_pool_drain();
+    free(docs.roots);
+    free(text.data);
+    return retval;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-m] [-s scale] [corpus...]\n", name);
+    fprintf(stderr, "  -m        one JSON object per result line\n");
+    fprintf(stderr, "  -s scale  corpus size multiplier (default 1)\n");
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int scale = 1, count;
+    bool machine = false, selected;
+    int opt, index, retval;
+
+    while ((opt = getopt(argc, argv, "ms:h")) != -1) {
+        switch (opt) {
+            case 'm':
+                machine = true;
+                break;
+
+            case 's':
+                scale = atoi(optarg);
+                if (scale)
+                    break;
+                /* fallthrough */
+
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    for (count = 0; count < ARRAY_SIZE(bench_corpus); ++count) {
+        selected = optind == argc;
+        for (index = optind; index < argc; ++index)
+            selected |= !strcmp(argv[index], bench_corpus[count].name);
+        if (!selected)
+            continue;
+
+        retval = bench_run(&bench_corpus[count], scale, machine);
+        if (retval) {
+            fprintf(stderr, "bench: %s failed: %d\n", bench_corpus[count].name, retval);
+            return 1;
+        }
+    }
+
+    return 0;
+}
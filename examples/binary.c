@@ -0,0 +1,167 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2022 Sanpe <sanpeqf@gmail.com>
+ */
+
+#include "example.h"
+#include <unistd.h>
+
+#define CORPUS_RECORDS  20000
+
+static const char *binary_tests[] = {
+    "[]",
+    "{}",
+    "[1, 2, [3, [4, 5]], {\"foo\": [\"bar\", \"baz\"]}]",
+    "{\"comment\": \"a fairly long string that must go to the pool\","
+    "\"doc\": {\"foo\": null, \"bar\": true, \"baz\": false},"
+    "\"patch\": [{\"op\": \"add\", \"path\": \"/-\", \"value\": 12345}],"
+    "\"expected\": {\"\": 0, \"a/b\": 1, \"a key longer than eight\": [{}, []]}}",
+};
+
+static int binary_roundtrip(const char *text)
+{
+    struct json_compact compact, loaded;
+    struct json_node *root, *expand, *damaged;
+    char *expect = NULL, *result = NULL;
+    size_t size, offset;
+    void *image;
+    int retval;
+
+    retval = json_parse(text, &root);
+    if (retval)
+        return retval;
+
+    retval = json_compact_build(&compact, root);
+    if (retval)
+        goto release;
+
+    size = json_compact_save(&compact, NULL, 0);
+    image = malloc(size);
+    if (!image) {
+        retval = -ENOMEM;
+        goto compact;
+    }
+    json_compact_save(&compact, image, size);
+
+    retval = json_compact_load(&loaded, image, size);
+    if (retval)
+        goto image;
+
+    retval = json_compact_expand(&loaded, 0, &expand);
+    if (retval)
+        goto image;
+
+    expect = encode_alloc(root, NULL);
+    result = encode_alloc(expand, NULL);
+    if (!expect || !result || strcmp(expect, result)) {
+        printf("round trip mismatch:\n%s\n%s\n", expect, result);
+        retval = -EINVAL;
+    }
+
+    /* a damaged image must be refused, never read out of bounds */
+    memset(&loaded, 0, sizeof(loaded));
+    if (json_compact_load(&loaded, image, size - 1) != -EINVAL || loaded.entries)
+        retval = -EINVAL;
+    for (offset = sizeof(struct json_binary_header); offset < size; ++offset) {
+        ((unsigned char *)image)[offset] ^= 0x5a;
+        if (!json_compact_load(&loaded, image, size) &&
+            !json_compact_expand(&loaded, 0, &damaged))
+            json_release(damaged);
+        ((unsigned char *)image)[offset] ^= 0x5a;
+    }
+
+    free(result);
+    free(expect);
+    json_release(expand);
+image:
+    free(image);
+compact:
+    json_compact_release(&compact);
+release:
+    json_release(root);
+    return retval;
+}
+
+static int binary_startup(void)
+{
+    char path[] = "/tmp/json-binary-XXXXXX";
+    struct json_compact compact;
+    struct json_node *root;
+    unsigned long long start;
+    double parse, load;
+    uint32_t index;
+    int64_t total;
+    char *corpus;
+    int retval, fd;
+
+    corpus = corpus_users(CORPUS_RECORDS);
+    if (!corpus)
+        return -ENOMEM;
+
+    start = time_ns();
+    retval = json_parse(corpus, &root);
+    parse = (time_ns() - start) / 1e6;
+    if (retval)
+        goto finish;
+
+    retval = json_compact_build(&compact, root);
+    json_release(root);
+    if (retval)
+        goto finish;
+
+    fd = mkstemp(path);
+    if (fd < 0) {
+        retval = -errno;
+        json_compact_release(&compact);
+        goto finish;
+    }
+    close(fd);
+
+    retval = json_compact_dump(&compact, path);
+    json_compact_release(&compact);
+    if (retval)
+        goto unlink;
+
+    start = time_ns();
+    retval = json_compact_open(&compact, path);
+    load = (time_ns() - start) / 1e6;
+    if (retval)
+        goto unlink;
+
+    /* query in place, no nodes are built */
+    total = 0;
+    json_compact_for_each(&compact, 0, index)
+        total += json_compact_number(&compact, json_compact_first(&compact, index));
+    json_compact_release(&compact);
+
+    printf("records:        %u\n", CORPUS_RECORDS);
+    printf("id sum:         %lld\n", (long long)total);
+    printf("json_parse:     %.3f ms\n", parse);
+    printf("binary open:    %.3f ms\n", load);
+
+unlink:
+    unlink(path);
+finish:
+    free(corpus);
+    return retval;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int count;
+    int retval;
+
+    for (count = 0; count < ARRAY_SIZE(binary_tests); ++count) {
+        retval = binary_roundtrip(binary_tests[count]);
+        if (retval) {
+            printf("round trip %u failed: %d\n", count, retval);
+            return retval;
+        }
+    }
+
+    printf("round trip:     %u documents ok\n", count);
+    retval = binary_startup();
+    json_pool_drain();
+
+    return retval;
+}
@@ -0,0 +1,185 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2022 Sanpe <sanpeqf@gmail.com>
+ */
+
+#include "example.h"
+
+#define BUILD_LOOPS 100000
+
+static const char build_expect[] =
+    "{\"id\":%ld,\"status\":\"ok\",\"cached\":false,\"message\":\"none\",\"items\":[0,1,2,3]}";
+
+static const char edit_expect[] =
+    "{\"list\":[1,true,3,\"v\"],\"map\":{\"b\":\"v\",\"c\":null}}";
+
+static struct json_node *build_response(long id)
+{
+    struct json_node *root, *items, *node;
+    unsigned int count;
+    int retval = 0;
+
+    root = json_create_object();
+    items = json_create_array();
+    if (!root || !items)
+        goto error;
+
+    retval |= json_append(root, "id", json_create_number(id));
+    retval |= json_append(root, "status", json_create_string("ok"));
+    retval |= json_append(root, "cached", json_create_bool(false));
+    retval |= json_append(root, "error", json_create_null());
+    retval |= json_append(root, "items", items);
+    if (retval)
+        goto error;
+
+    for (count = 0; count < 4; ++count) {
+        node = json_create_number(count);
+        if (!node || json_append(items, NULL, node))
+            goto error;
+    }
+
+    /* replace the null placeholder with a real value */
+    node = list_entry(root->child.prev->prev, struct json_node, sibling);
+    if (json_insert(node, "message", json_create_string("none")))
+        goto error;
+    json_remove(node);
+
+    return root;
+
+error:
+    if (items && !items->parent)
+        json_release(items);
+    json_release(root);
+    return NULL;
+}
+
+static int build_check(struct json_node *root, const char *expect)
+{
+    struct json_option option = { .encode = JSON_ENCODE_COMPACT };
+    char *text;
+    int retval;
+
+    text = encode_alloc(root, &option);
+    retval = text && !strcmp(text, expect) ? 0 : -EBADMSG;
+    if (retval)
+        printf("expected %s\ngot      %s\n", expect, text);
+
+    free(text);
+    return retval;
+}
+
+static int build_expect_retval(const char *what, int retval, int expect)
+{
+    if (retval == expect)
+        return 0;
+
+    printf("%s: got %d, expected %d\n", what, retval, expect);
+    return -EBADMSG;
+}
+
+/* a node that failed to link is still the caller's */
+static int build_refused(const char *what, int retval, int expect, struct json_node *node)
+{
+    json_release(node);
+    return build_expect_retval(what, retval, expect);
+}
+
+static int build_edit(void)
+{
+    struct json_node *root, *array, *object, *one, *two, *node;
+    int retval = 0;
+
+    root = json_create_object();
+    array = json_create_array();
+    object = json_create_object();
+    if (!root || !array || !object ||
+        json_append(root, "list", array) || json_append(root, "map", object)) {
+        if (array && !array->parent)
+            json_release(array);
+        if (object && !object->parent)
+            json_release(object);
+        json_release(root);
+        return -ENOMEM;
+    }
+
+    /* insert goes in front of its sibling, names are dropped in arrays */
+    two = json_create_number(2);
+    one = json_create_number(1);
+    retval |= json_append(array, NULL, two);
+    retval |= json_insert(two, NULL, one);
+    retval |= json_append(array, NULL, json_create_number(3));
+    retval |= json_insert(two, "dropped", json_create_bool(true));
+    json_remove(two);
+    if (retval)
+        goto finish;
+
+    /* appending into an object replaces the name, or keeps it given none */
+    node = json_create_string("v");
+    retval |= json_append(object, "a", node);
+    json_detach(node);
+    retval |= json_append(object, "b", node);
+    json_detach(node);
+    retval |= json_append(object, NULL, node);
+    retval |= json_append(object, "c", json_create_null());
+    if (retval)
+        goto finish;
+
+    node = json_create_string("v");
+    retval |= json_append(array, NULL, node);
+    json_detach(node);
+    retval |= json_append(array, NULL, node);
+    if (retval)
+        goto finish;
+
+    node = json_create_number(0);
+    retval |= build_refused("append into a scalar", json_append(one, NULL, node), -EINVAL, node);
+    node = json_create_number(0);
+    retval |= build_refused("unnamed object member", json_append(object, NULL, node), -EINVAL, node);
+    node = json_create_number(0);
+    retval |= build_refused("insert beside a root", json_insert(root, "x", node), -EINVAL, node);
+    retval |= build_expect_retval("append a failed create", json_append(array, NULL, NULL), -ENOMEM);
+    retval |= build_expect_retval("append a linked node", json_append(object, "x", one), -EBUSY);
+    retval |= build_expect_retval("append into itself", json_append(root, "x", root), -EBUSY);
+    retval |= build_expect_retval("append into a descendant", json_append(array, NULL, root), -EBUSY);
+    retval |= build_expect_retval("insert into a descendant", json_insert(one, NULL, root), -EBUSY);
+    if (retval)
+        goto finish;
+
+    /* detaching a root does nothing, refused links left the tree alone */
+    json_detach(root);
+    retval = build_check(root, edit_expect);
+
+finish:
+    json_release(root);
+    return retval;
+}
+
+int main(int argc, char *argv[])
+{
+    struct json_node *root;
+    unsigned int count;
+    char expect[128];
+    int retval;
+
+    retval = build_edit();
+    if (retval)
+        return 1;
+
+    for (count = 0; count < BUILD_LOOPS; ++count) {
+        root = build_response(count);
+        if (!root)
+            return 1;
+
+        snprintf(expect, sizeof(expect), build_expect, (long)count);
+        retval = build_check(root, expect);
+        json_release(root);
+        if (retval)
+            return 1;
+    }
+
+    printf("edits:           ok\n");
+    printf("responses:       %u\n", BUILD_LOOPS);
+
+    json_pool_drain();
+    return 0;
+}
@@ -0,0 +1,101 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2022 Sanpe <sanpeqf@gmail.com>
+ */
+
+#include "example.h"
+
+#define CORPUS_RECORDS  10000
+
+static int compact_verify(struct json_compact *compact, uint32_t index,
+                          struct json_node *node, unsigned long *nodes)
+{
+    struct json_node *child;
+    const char *name;
+    uint32_t walk;
+
+    ++*nodes;
+    name = json_compact_name(compact, index);
+    if (index && node->name && (!name || strcmp(name, node->name)))
+        return -EINVAL;
+
+    switch (json_compact_type(compact, index)) {
+        case JSON_CTYPE_ARRAY: case JSON_CTYPE_OBJECT:
+            if (!json_test_array(node) && !json_test_object(node))
+                return -EINVAL;
+            walk = json_compact_first(compact, index);
+            list_for_each_entry(child, &node->child, sibling) {
+                if (!walk || compact_verify(compact, walk, child, nodes))
+                    return -EINVAL;
+                walk = json_compact_next(compact, walk);
+            }
+            return walk ? -EINVAL : 0;
+
+        case JSON_CTYPE_STRING:
+            return json_test_string(node) &&
+                !strcmp(json_compact_text(compact, index), node->string) ? 0 : -EINVAL;
+
+        case JSON_CTYPE_NUMBER:
+            return json_test_number(node) &&
+                json_compact_number(compact, index) == node->number ? 0 : -EINVAL;
+
+        case JSON_CTYPE_TRUE:
+            return json_test_true(node) ? 0 : -EINVAL;
+
+        case JSON_CTYPE_FALSE:
+            return json_test_false(node) ? 0 : -EINVAL;
+
+        case JSON_CTYPE_NULL:
+            return json_test_null(node) ? 0 : -EINVAL;
+
+        default:
+            return -EINVAL;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    struct json_compact compact;
+    struct json_node *root;
+    unsigned long nodes = 0;
+    size_t tree, packed;
+    char *corpus;
+    int retval;
+
+    corpus = corpus_users(CORPUS_RECORDS);
+    if (!corpus)
+        return -ENOMEM;
+
+    retval = json_parse(corpus, &root);
+    if (retval)
+        goto finish;
+
+    retval = json_compact_build(&compact, root);
+    if (retval)
+        goto release;
+
+    retval = compact_verify(&compact, 0, root, &nodes);
+    if (retval) {
+        printf("compact tree mismatch\n");
+        goto compact;
+    }
+
+    tree = json_memory(root);
+    packed = json_compact_memory(&compact);
+
+    printf("nodes:             %lu\n", nodes);
+    printf("node size:         %zu bytes\n", sizeof(struct json_node));
+    printf("entry size:        %zu bytes\n", sizeof(struct json_centry));
+    printf("tree memory:       %zu bytes (%.1f per node)\n", tree, (double)tree / nodes);
+    printf("compact memory:    %zu bytes (%.1f per node)\n", packed, (double)packed / nodes);
+    printf("compact / tree:    %.1f%%\n", 100.0 * packed / tree);
+
+compact:
+    json_compact_release(&compact);
+release:
+    json_release(root);
+    json_pool_drain();
+finish:
+    free(corpus);
+    return retval;
+}
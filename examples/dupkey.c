@@ -0,0 +1,125 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2022 Sanpe <sanpeqf@gmail.com>
+ */
+
+#include "example.h"
+
+#define DUPKEY_MEMBERS  100000
+
+static const char dupkey_text[] =
+    "{\"id\": 1, \"tags\": {\"a\": 1, \"a\": 2}, \"name\": \"x\", \"id\": 2, \"id\": 3}";
+
+static const struct {
+    enum json_dupkey dupkey;
+    int retval;
+    const char *expect;
+} dupkey_cases[] = {
+    { JSON_DUPKEY_APPEND, 0, "{\"id\":1,\"tags\":{\"a\":1,\"a\":2},\"name\":\"x\",\"id\":2,\"id\":3}" },
+    { JSON_DUPKEY_FIRST, 0, "{\"id\":1,\"tags\":{\"a\":1},\"name\":\"x\"}" },
+    { JSON_DUPKEY_LAST, 0, "{\"tags\":{\"a\":2},\"name\":\"x\",\"id\":3}" },
+    { JSON_DUPKEY_ERROR, -EEXIST, NULL },
+};
+
+/* same content, different member order and layout */
+static const char *canonical_text[] = {
+    "{\"b\": [1, {\"y\": 2, \"x\": 1}], \"a\": null, \"\\u00e9\": true, \"c\": \"s\"}",
+    "{ \"c\" : \"s\", \"\xc3\xa9\": true, \"a\": null,\n \"b\": [1, {\"x\": 1, \"y\": 2}] }",
+};
+
+static const char canonical_expect[] =
+    "{\"a\":null,\"b\":[1,{\"x\":1,\"y\":2}],\"c\":\"s\",\"\xc3\xa9\":true}";
+
+static char *corpus_generate(unsigned int members)
+{
+    struct example_buff buff = {};
+    unsigned int count;
+
+    /* every other member repeats an earlier key */
+    buff_printf(&buff, "{");
+    for (count = 0; count < members; ++count)
+        buff_printf(&buff, "%s\"key%u\": %u", count ? ", " : "",
+                    count & 1 ? count / 2 : count, count);
+    buff_printf(&buff, "}");
+
+    return buff.data;
+}
+
+static int time_policy(const char *corpus, enum json_dupkey dupkey, unsigned long long *ns)
+{
+    struct json_option option = { .dupkey = dupkey };
+    unsigned long long start;
+    struct json_node *root;
+    int retval;
+
+    start = time_ns();
+    retval = json_parse_option(corpus, &root, &option);
+    *ns = time_ns() - start;
+    if (!retval)
+        json_release(root);
+
+    return retval;
+}
+
+int main(int argc, char *argv[])
+{
+    struct json_option option = {};
+    unsigned long long append_ns, last_ns;
+    struct json_node *root;
+    char *text, *corpus;
+    unsigned int count;
+    int retval;
+
+    option.encode = JSON_ENCODE_COMPACT;
+    for (count = 0; count < ARRAY_SIZE(dupkey_cases); ++count) {
+        option.dupkey = dupkey_cases[count].dupkey;
+        retval = json_parse_option(dupkey_text, &root, &option);
+        if (retval != dupkey_cases[count].retval) {
+            printf("policy %d: got %d\n", option.dupkey, retval);
+            return 1;
+        }
+        if (retval)
+            continue;
+
+        text = encode_alloc(root, &option);
+        json_release(root);
+        if (!text || strcmp(text, dupkey_cases[count].expect)) {
+            printf("policy %d: got %s\n", option.dupkey, text);
+            return 1;
+        }
+        printf("policy %d:        %s\n", option.dupkey, text);
+        free(text);
+    }
+
+    option.dupkey = JSON_DUPKEY_ERROR;
+    option.encode = JSON_ENCODE_SORTED | JSON_ENCODE_COMPACT;
+    for (count = 0; count < ARRAY_SIZE(canonical_text); ++count) {
+        if (json_parse_option(canonical_text[count], &root, &option))
+            return 1;
+        text = encode_alloc(root, &option);
+        json_release(root);
+        if (!text || strcmp(text, canonical_expect)) {
+            printf("canonical %u: got %s\n", count, text);
+            return 1;
+        }
+        free(text);
+    }
+    printf("canonical:       %s\n", canonical_expect);
+
+    corpus = corpus_generate(DUPKEY_MEMBERS);
+    if (!corpus)
+        return 1;
+
+    retval = time_policy(corpus, JSON_DUPKEY_APPEND, &append_ns);
+    retval |= time_policy(corpus, JSON_DUPKEY_LAST, &last_ns);
+    free(corpus);
+    if (retval)
+        return 1;
+
+    printf("members:         %u\n", DUPKEY_MEMBERS);
+    printf("append parse:    %llu us\n", append_ns / 1000);
+    printf("last-wins parse: %llu us\n", last_ns / 1000);
+
+    json_pool_drain();
+    return 0;
+}
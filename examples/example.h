@@ -0,0 +1,132 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2022 Sanpe <sanpeqf@gmail.com>
+ */
+
+#ifndef _EXAMPLE_H_
+#define _EXAMPLE_H_
+
+#include "json.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+struct example_buff {
+    char *data;
+    size_t len, size;
+};
+
+/* corpora are generated up front, running out of memory ends the example */
+static inline void buff_printf(struct example_buff *buff, const char *fmt, ...)
+{
+    va_list args;
+    int length;
+
+    for (;;) {
+        va_start(args, fmt);
+        length = vsnprintf(buff->data + buff->len, buff->size - buff->len, fmt, args);
+        va_end(args);
+
+        if (buff->len + length < buff->size)
+            break;
+
+        buff->size = (buff->size + length) * 2;
+        buff->data = realloc(buff->data, buff->size);
+        if (!buff->data) {
+            fprintf(stderr, "example: out of memory\n");
+            exit(1);
+        }
+    }
+
+    buff->len += length;
+}
+
+static inline unsigned long long time_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static inline char *encode_alloc(struct json_node *root, const struct json_option *option)
+{
+    char *buff;
+    int length;
+
+    length = json_encode_option(root, NULL, 0, option);
+    if (length < 0)
+        return NULL;
+
+    buff = malloc(length);
+    if (buff)
+        json_encode_option(root, buff, length, option);
+
+    return buff;
+}
+
+/* an array of small user records, mixing every value type */
+static inline char *corpus_users(unsigned int records)
+{
+    struct example_buff buff = {};
+    unsigned int count;
+
+    buff_printf(&buff, "[");
+    for (count = 0; count < records; ++count)
+        buff_printf(&buff,
+            "%s{\"id\": %u, \"name\": \"user%u\", \"active\": %s, \"manager\": null,"
+            "\"email\": \"user%u@example.com\", \"scores\": [%u, %u, %u]}",
+            count ? "," : "", count, count, count & 1 ? "true" : "false",
+            count, count % 7, count % 11, count % 13);
+    buff_printf(&buff, "]");
+
+    return buff.data;
+}
+
+#ifdef EXAMPLE_ALLOC_COUNT
+/*
+ * Counts every allocation the library makes, the example has to be
+ * linked with $(bench_wrap) so the calls are routed through here.
+ */
+static struct {
+    unsigned long long count;
+    unsigned long long bytes;
+} example_alloc;
+
+extern void *__real_malloc(size_t size);
+extern void *__real_calloc(size_t nmemb, size_t size);
+extern void *__real_realloc(void *ptr, size_t size);
+extern char *__real_strdup(const char *string);
+
+void *__wrap_malloc(size_t size)
+{
+    example_alloc.count++;
+    example_alloc.bytes += size;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+    example_alloc.count++;
+    example_alloc.bytes += nmemb * size;
+    return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    example_alloc.count++;
+    example_alloc.bytes += size;
+    return __real_realloc(ptr, size);
+}
+
+char *__wrap_strdup(const char *string)
+{
+    example_alloc.count++;
+    example_alloc.bytes += strlen(string) + 1;
+    return __real_strdup(string);
+}
+#endif  /* EXAMPLE_ALLOC_COUNT */
+
+#endif  /* _EXAMPLE_H_ */
@@ -0,0 +1,131 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2022 Sanpe <sanpeqf@gmail.com>
+ */
+
+#include "example.h"
+#include <pthread.h>
+
+#define FROZEN_RECORDS  2000
+#define FROZEN_THREADS  8
+#define FROZEN_ROUNDS   20
+
+static const char *record_keys[] = {
+    "id", "name", "region", "weight", "enabled", "tags",
+};
+
+static char *corpus_generate(unsigned int records)
+{
+    struct example_buff buff = {};
+    unsigned int count;
+
+    buff_printf(&buff, "{");
+    for (count = 0; count < records; ++count)
+        buff_printf(&buff,
+                    "%s\"r%u\": {\"id\": %u, \"name\": \"n%u\", \"region\": \"eu\", "
+                    "\"weight\": %u, \"enabled\": true, \"tags\": [1, 2]}",
+                    count ? "," : "", count, count, count, count % 7);
+    buff_printf(&buff, "}");
+
+    return buff.data;
+}
+
+static struct json_node *linear_lookup(struct json_node *object, const char *name)
+{
+    struct json_node *child;
+
+    list_for_each_entry(child, &object->child, sibling) {
+        if (!strcmp(child->name, name))
+            return child;
+    }
+
+    return NULL;
+}
+
+static void *frozen_reader(void *arg)
+{
+    struct json_frozen *frozen = arg;
+    struct json_node *root, *record, *field;
+    unsigned int round, count, index;
+    unsigned long errors = 0;
+    char name[16];
+
+    root = json_frozen_root(frozen);
+    for (round = 0; round < FROZEN_ROUNDS; ++round) {
+        for (count = 0; count < FROZEN_RECORDS; ++count) {
+            snprintf(name, sizeof(name), "r%u", count);
+            record = json_frozen_lookup(frozen, root, name);
+            if (!record || record != linear_lookup(root, name)) {
+                errors++;
+                continue;
+            }
+
+            for (index = 0; index < ARRAY_SIZE(record_keys); ++index) {
+                field = json_frozen_lookup(frozen, record, record_keys[index]);
+                if (field != linear_lookup(record, record_keys[index]))
+                    errors++;
+            }
+
+            if (json_frozen_lookup(frozen, record, "missing") ||
+                json_frozen_lookup(frozen, record, name))
+                errors++;
+            if (json_frozen_lookup(frozen, record, "id")->number != count)
+                errors++;
+        }
+    }
+
+    /* the last put may land here, the pool goes with the thread */
+    json_frozen_put(frozen);
+    return (void *)errors;
+}
+
+int main(int argc, char *argv[])
+{
+    pthread_t threads[FROZEN_THREADS];
+    struct json_frozen *frozen;
+    struct json_node *root;
+    unsigned long errors = 0;
+    unsigned int count;
+    void *result;
+    char *corpus;
+    int retval;
+
+    corpus = corpus_generate(FROZEN_RECORDS);
+    if (!corpus)
+        return -ENOMEM;
+
+    retval = json_parse(corpus, &root);
+    free(corpus);
+    if (retval)
+        return retval;
+
+    frozen = json_freeze(root);
+    if (!frozen) {
+        json_release(root);
+        return -ENOMEM;
+    }
+
+    /* every reader owns a reference, the last put releases the tree */
+    for (count = 0; count < FROZEN_THREADS; ++count) {
+        retval = pthread_create(&threads[count], NULL, frozen_reader,
+                                json_frozen_get(frozen));
+        if (retval) {
+            json_frozen_put(frozen);
+            break;
+        }
+    }
+    json_frozen_put(frozen);
+
+    while (count--) {
+        pthread_join(threads[count], &result);
+        errors += (unsigned long)result;
+    }
+
+    printf("threads:  %u\n", FROZEN_THREADS);
+    printf("lookups:  %u\n", FROZEN_THREADS * FROZEN_ROUNDS * FROZEN_RECORDS *
+           (unsigned int)(ARRAY_SIZE(record_keys) + 4));
+    printf("errors:   %lu\n", errors);
+
+    json_pool_drain();
+    return retval ? -retval : !!errors;
+}
@@ -0,0 +1,133 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2022 Sanpe <sanpeqf@gmail.com>
+ */
+
+#include "example.h"
+#include <malloc.h>
+
+#define CORPUS_RECORDS  20000
+
+static const char *corpus_keys[] = {
+    "id", "timestamp", "hostname", "service", "severity",
+    "message", "request_id", "duration", "status", "region",
+};
+
+static char *corpus_generate(unsigned int records)
+{
+    struct example_buff buff = {};
+    unsigned int count, index;
+
+    buff_printf(&buff, "[");
+    for (count = 0; count < records; ++count) {
+        buff_printf(&buff, "%s{", count ? "," : "");
+        for (index = 0; index < ARRAY_SIZE(corpus_keys); ++index)
+            buff_printf(&buff, "%s\"%s\": %u", index ? "," : "",
+                        corpus_keys[index], count + index);
+        buff_printf(&buff, "}");
+    }
+    buff_printf(&buff, "]");
+
+    return buff.data;
+}
+
+static size_t heap_used(void)
+{
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+static unsigned long count_key(struct json_node *parent, const char *key)
+{
+    struct json_node *child;
+    unsigned long count = 0;
+
+    list_for_each_entry(child, &parent->child, sibling) {
+        if (child->name == key)
+            count++;
+        if (json_test_array(child) || json_test_object(child))
+            count += count_key(child, key);
+    }
+
+    return count;
+}
+
+static size_t name_bytes(struct json_node *parent, unsigned long *names)
+{
+    struct json_node *child;
+    size_t bytes = 0;
+
+    list_for_each_entry(child, &parent->child, sibling) {
+        if (child->name) {
+            bytes += strlen(child->name) + 1;
+            (*names)++;
+        }
+        if (json_test_array(child) || json_test_object(child))
+            bytes += name_bytes(child, names);
+    }
+
+    return bytes;
+}
+
+int main(int argc, char *argv[])
+{
+    struct json_option option = {};
+    struct json_node *plain, *shared;
+    size_t before, plain_heap, shared_heap;
+    unsigned long names = 0, matches;
+    size_t bytes;
+    const char *key;
+    char *corpus;
+    int retval;
+
+    corpus = corpus_generate(CORPUS_RECORDS);
+    if (!corpus)
+        return -ENOMEM;
+
+    option.intern = json_intern_create();
+    if (!option.intern) {
+        free(corpus);
+        return -ENOMEM;
+    }
+
+    before = heap_used();
+    retval = json_parse(corpus, &plain);
+    if (retval)
+        goto finish;
+    plain_heap = heap_used() - before;
+
+    before = heap_used();
+    retval = json_parse_option(corpus, &shared, &option);
+    if (retval) {
+        json_release(plain);
+        goto finish;
+    }
+    shared_heap = heap_used() - before;
+
+    /* interned names compare by pointer */
+    key = json_intern_lookup(option.intern, "request_id");
+    matches = key ? count_key(shared, key) : 0;
+    if (matches != CORPUS_RECORDS) {
+        retval = -ENOENT;
+        goto release;
+    }
+
+    bytes = name_bytes(plain, &names);
+    printf("records:         %u\n", CORPUS_RECORDS);
+    printf("names:           %lu (%u unique)\n", names, json_intern_count(option.intern));
+    printf("name bytes:      %zu\n", bytes);
+    printf("intern bytes:    %zu\n", json_intern_memory(option.intern));
+    printf("heap (strdup):   %zu\n", plain_heap);
+    printf("heap (intern):   %zu\n", shared_heap);
+    printf("heap saved:      %zu (%.1f%%)\n", plain_heap - shared_heap,
+           100.0 * (plain_heap - shared_heap) / plain_heap);
+
+release:
+    json_release(shared);
+    json_release(plain);
+finish:
+    json_intern_destroy(option.intern);
+    json_pool_drain();
+    free(corpus);
+    return retval;
+}
@@ -0,0 +1,174 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2022 Sanpe <sanpeqf@gmail.com>
+ */
+
+#define EXAMPLE_ALLOC_COUNT
+#include "example.h"
+
+#define REUSE_MESSAGES  64
+#define REUSE_WARMUP    2
+#define REUSE_ROUNDS    200
+
+/* structurally similar messages whose strings and arrays vary in length */
+static char *message_generate(unsigned int index)
+{
+    struct example_buff buff = {};
+    unsigned int count;
+
+    buff_printf(&buff,
+                "{\"id\": %u, \"user\": \"user-%0*u\", \"note\": \"line\\n%.*s\","
+                " \"ok\": %s, \"items\": [",
+                index, (int)(index % 9 + 1), index, (int)(index % 40),
+                "abcdefghijklmnopqrstuvwxyz0123456789ABCD", index & 1 ? "true" : "false");
+    for (count = 0; count < index % 17 + 1; ++count)
+        buff_printf(&buff, "%s{\"sku\": \"s%u\", \"qty\": %u}",
+                    count ? ", " : "", count * index, count);
+    buff_printf(&buff, "], \"meta\": {\"region\": \"eu\", \"trace\": null}}");
+
+    return buff.data;
+}
+
+static int same_encoding(struct json_node *a, struct json_node *b)
+{
+    char *ea, *eb;
+    int retval;
+
+    ea = encode_alloc(a, NULL);
+    eb = encode_alloc(b, NULL);
+    if (!ea || !eb)
+        retval = -ENOMEM;
+    else
+        retval = strcmp(ea, eb) ? -EBADMSG : 0;
+
+    free(ea);
+    free(eb);
+    return retval;
+}
+
+/* a parser that does not reuse takes back any whole tree, never a subtree */
+static int plain_recycle(const char *message)
+{
+    struct json_parser *parser;
+    struct json_node *root;
+    int retval;
+
+    parser = json_parser_create(NULL);
+    if (!parser)
+        return -ENOMEM;
+
+    retval = json_parse(message, &root);
+    if (!retval) {
+        if (json_parser_recycle(parser, list_first_entry(&root->child,
+                                struct json_node, sibling)) != -EINVAL)
+            retval = -EBADMSG;
+        if (json_parser_recycle(parser, root) && !retval)
+            retval = -EBADMSG;
+    }
+
+    json_parser_destroy(parser);
+    return retval;
+}
+
+int main(int argc, char *argv[])
+{
+    char *messages[REUSE_MESSAGES] = {};
+    unsigned long long start, plain_ns, reuse_ns;
+    unsigned long long plain_allocs, reuse_allocs;
+    struct json_parser *parser;
+    struct json_node *root, *expect;
+    unsigned int round, count;
+    int retval = -ENOMEM;
+
+    parser = json_parser_create_reuse(NULL);
+    if (!parser)
+        return 1;
+
+    for (count = 0; count < REUSE_MESSAGES; ++count) {
+        messages[count] = message_generate(count);
+        if (!messages[count])
+            goto finish;
+    }
+
+    /* the reused trees must look exactly like freshly parsed ones */
+    for (count = 0; count < REUSE_MESSAGES; ++count) {
+        retval = json_parse(messages[count], &expect);
+        if (retval)
+            goto finish;
+        retval = json_parser_parse(parser, messages[count], &root);
+        if (retval) {
+            json_release(expect);
+            goto finish;
+        }
+        retval = same_encoding(expect, root);
+        if (!retval && (json_parser_recycle(parser, expect) != -EINVAL ||
+            json_parser_recycle(parser, list_first_entry(&root->child,
+                                struct json_node, sibling)) != -EINVAL))
+            retval = -EBADMSG;
+        if (json_parser_recycle(parser, root) && !retval)
+            retval = -EBADMSG;
+        /* a tree only goes back once */
+        if (!retval && json_parser_recycle(parser, root) != -EINVAL)
+            retval = -EBADMSG;
+        json_release(expect);
+        if (retval)
+            goto finish;
+    }
+
+    retval = plain_recycle(messages[0]);
+    if (retval)
+        goto finish;
+
+    for (round = 0; round < REUSE_WARMUP; ++round) {
+        for (count = 0; count < REUSE_MESSAGES; ++count) {
+            retval = json_parser_parse(parser, messages[count], &root);
+            if (retval)
+                goto finish;
+            json_parser_recycle(parser, root);
+        }
+    }
+
+    example_alloc.count = 0;
+    start = time_ns();
+    for (round = 0; round < REUSE_ROUNDS; ++round) {
+        for (count = 0; count < REUSE_MESSAGES; ++count) {
+            retval = json_parser_parse(parser, messages[count], &root);
+            if (retval)
+                goto finish;
+            json_parser_recycle(parser, root);
+        }
+    }
+    reuse_ns = time_ns() - start;
+    reuse_allocs = example_alloc.count;
+
+    example_alloc.count = 0;
+    start = time_ns();
+    for (round = 0; round < REUSE_ROUNDS; ++round) {
+        for (count = 0; count < REUSE_MESSAGES; ++count) {
+            retval = json_parse(messages[count], &root);
+            if (retval)
+                goto finish;
+            json_release(root);
+        }
+    }
+    plain_ns = time_ns() - start;
+    plain_allocs = example_alloc.count;
+
+    count = REUSE_ROUNDS * REUSE_MESSAGES;
+    printf("messages:        %u\n", count);
+    printf("parse allocs:    %.2f per message\n", (double)plain_allocs / count);
+    printf("reuse allocs:    %.2f per message\n", (double)reuse_allocs / count);
+    printf("parse time:      %llu ns per message\n", plain_ns / count);
+    printf("reuse time:      %llu ns per message\n", reuse_ns / count);
+
+    /* steady state means no allocation at all */
+    retval = reuse_allocs ? -EBUSY : 0;
+
+finish:
+    for (count = 0; count < REUSE_MESSAGES; ++count)
+        free(messages[count]);
+
+    json_parser_destroy(parser);
+    json_pool_drain();
+    return -retval;
+}
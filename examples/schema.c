@@ -0,0 +1,239 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2022 Sanpe <sanpeqf@gmail.com>
+ */
+
+#include "example.h"
+
+#define SCHEMA_LOOPS    200000
+
+struct position {
+    int32_t x, y;
+};
+
+struct message {
+    int64_t id;
+    uint16_t weight;
+    int8_t level;
+    bool enabled;
+    char *name;
+    char region[8];
+    struct position origin;
+};
+
+static JSON_SCHEMA(position_schema, struct position,
+    JSON_FIELD(struct position, x, JSON_FTYPE_INT),
+    JSON_FIELD(struct position, y, JSON_FTYPE_INT),
+);
+
+static JSON_SCHEMA(message_schema, struct message,
+    JSON_FIELD(struct message, id, JSON_FTYPE_INT),
+    JSON_FIELD(struct message, weight, JSON_FTYPE_UINT),
+    JSON_FIELD(struct message, level, JSON_FTYPE_INT),
+    JSON_FIELD(struct message, enabled, JSON_FTYPE_BOOL),
+    JSON_FIELD(struct message, name, JSON_FTYPE_STRING),
+    JSON_FIELD(struct message, region, JSON_FTYPE_BUFFER),
+    JSON_FIELD_STRUCT(struct message, origin, position_schema),
+);
+
+static const char message_text[] =
+    "{\"id\": -9007199254740993, \"trace\": {\"spans\": [1, [2, {\"a\": null}]], \"ok\": true},"
+    " \"weight\": 65535, \"level\": -128, \"enabled\": true, \"name\": \"caf\\u00e9 \\\"bar\\\"\","
+    " \"region\": \"eu\\u002dw1\", \"origin\": {\"y\": -7, \"x\": 3, \"z\": -15}, \"tail\": \"x\"}";
+
+static const struct {
+    const char *text;
+    int retval;
+} failure_cases[] = {
+    { "{\"weight\": 65536}",          -ERANGE },
+    { "{\"weight\": -1}",             -ERANGE },
+    { "{\"level\": 128}",             -ERANGE },
+    { "{\"id\": 99999999999999999999}", -ERANGE },
+    { "{\"region\": \"12345678\"}",   -ENOSPC },
+    { "{\"enabled\": 1}",             -EINVAL },
+    { "{\"name\": 12}",               -EINVAL },
+    { "{\"name\": \"\\ud800\"}",      -EILSEQ },
+    { "{\"origin\": []}",             -EINVAL },
+    { "{\"id\": 1,}",                 -EINVAL },
+    { "{\"id\": 1} x",                -EINVAL },
+    { "{\"skip\": [1, 2}",            -EINVAL },
+    { "[]",                           -EINVAL },
+    { "{\"id\": 1.9e5}",              -EINVAL },
+    { "{\"id\": 12-3}",               -EINVAL },
+    { "{\"id\": 01}",                 -EINVAL },
+    { "{\"skip\": 1.5}",              -EINVAL },
+    { "{\"skip\": 9223372036854775808}", -ERANGE },
+    { "{\"skip\": \"\\x\"}",          -EINVAL },
+    { "{\"skip\": \"\x01\"}",          -EINVAL },
+    { "{\"sk\\ud800\": 1}",           -EILSEQ },
+    { "{\"id\": 1 2}",                -EINVAL },
+    { "{\"id\": \xc3\xa9}",           -EINVAL },
+    { "{\"skip\": \xc3\xa9}",         -EINVAL },
+};
+
+struct counter {
+    uint64_t seq;
+};
+
+static JSON_SCHEMA(counter_schema, struct counter,
+    JSON_FIELD(struct counter, seq, JSON_FTYPE_UINT),
+);
+
+static const struct {
+    const char *text;
+    int retval;
+    uint64_t seq;
+} counter_cases[] = {
+    { "{\"seq\": 9223372036854775808}",  0, 9223372036854775808ULL },
+    { "{\"seq\": 18446744073709551615}", 0, UINT64_MAX },
+    { "{\"seq\": 18446744073709551616}", -ERANGE },
+    { "{\"seq\": -0}",                   0, 0 },
+    { "{\"seq\": -1}",                   -ERANGE },
+};
+
+static struct json_node *tree_lookup(struct json_node *object, const char *name)
+{
+    struct json_node *child;
+
+    list_for_each_entry(child, &object->child, sibling) {
+        if (!strcmp(child->name, name))
+            return child;
+    }
+
+    return NULL;
+}
+
+/* what the hot paths did before: build a tree, copy out, release */
+static int tree_decode(const char *text, struct message *msg)
+{
+    struct json_node *root, *node, *origin;
+    int retval;
+
+    retval = json_parse(text, &root);
+    if (retval)
+        return retval;
+
+    if ((node = tree_lookup(root, "id")))
+        msg->id = node->number;
+    if ((node = tree_lookup(root, "weight")))
+        msg->weight = node->number;
+    if ((node = tree_lookup(root, "level")))
+        msg->level = node->number;
+    if ((node = tree_lookup(root, "enabled")))
+        msg->enabled = json_test_true(node);
+    if ((node = tree_lookup(root, "name"))) {
+        free(msg->name);
+        msg->name = strdup(node->string);
+    }
+    if ((node = tree_lookup(root, "region")))
+        snprintf(msg->region, sizeof(msg->region), "%s", node->string);
+    if ((origin = tree_lookup(root, "origin"))) {
+        if ((node = tree_lookup(origin, "x")))
+            msg->origin.x = node->number;
+        if ((node = tree_lookup(origin, "y")))
+            msg->origin.y = node->number;
+    }
+
+    json_release(root);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    struct message msg = {}, back = {};
+    unsigned long long start, tree_ns, schema_ns;
+    struct json_node *root;
+    char *buff, *expect;
+    unsigned int count;
+    int retval, length;
+
+    json_schema_prepare(&message_schema);
+
+    retval = json_struct_decode(&message_schema, message_text, &msg);
+    if (retval) {
+        printf("decode failed: %d\n", retval);
+        return 1;
+    }
+
+    if (msg.id != -9007199254740993LL || msg.weight != 65535 || msg.level != -128 ||
+        !msg.enabled || strcmp(msg.name, "caf\xc3\xa9 \"bar\"") ||
+        strcmp(msg.region, "eu-w1") || msg.origin.x != 3 || msg.origin.y != -7) {
+        printf("decode mismatch\n");
+        return 1;
+    }
+
+    /* struct encoding matches what the tree encoder prints */
+    length = json_struct_encode(&message_schema, &msg, NULL, 0);
+    buff = malloc(length);
+    if (!buff)
+        return 1;
+    json_struct_encode(&message_schema, &msg, buff, length);
+    printf("%s", buff);
+
+    if (json_parse(buff, &root))
+        return 1;
+    expect = malloc(json_encode(root, NULL, 0));
+    if (!expect)
+        return 1;
+    json_encode(root, expect, json_encode(root, NULL, 0));
+    json_release(root);
+    if (strcmp(buff, expect)) {
+        printf("encode mismatch\n");
+        return 1;
+    }
+
+    if (json_struct_decode(&message_schema, buff, &back) ||
+        strcmp(back.name, msg.name) || back.id != msg.id ||
+        memcmp(&back.origin, &msg.origin, sizeof(msg.origin))) {
+        printf("round trip mismatch\n");
+        return 1;
+    }
+
+    for (count = 0; count < ARRAY_SIZE(failure_cases); ++count) {
+        retval = json_struct_decode(&message_schema, failure_cases[count].text, &back);
+        if (retval != failure_cases[count].retval) {
+            printf("case '%s': got %d, want %d\n", failure_cases[count].text,
+                   retval, failure_cases[count].retval);
+            return 1;
+        }
+    }
+
+    for (count = 0; count < ARRAY_SIZE(counter_cases); ++count) {
+        struct counter counter = {};
+
+        retval = json_struct_decode(&counter_schema, counter_cases[count].text, &counter);
+        if (retval != counter_cases[count].retval ||
+            (!retval && counter.seq != counter_cases[count].seq)) {
+            printf("case '%s': got %d (%llu)\n", counter_cases[count].text,
+                   retval, (unsigned long long)counter.seq);
+            return 1;
+        }
+    }
+
+    /* the baseline must decode too, or it only times the failure */
+    if (tree_decode(message_text, &back)) {
+        printf("tree decode failed\n");
+        return 1;
+    }
+
+    start = time_ns();
+    for (count = 0; count < SCHEMA_LOOPS; ++count)
+        tree_decode(message_text, &back);
+    tree_ns = time_ns() - start;
+
+    start = time_ns();
+    for (count = 0; count < SCHEMA_LOOPS; ++count)
+        json_struct_decode(&message_schema, message_text, &back);
+    schema_ns = time_ns() - start;
+
+    printf("tree decode:     %llu ns/msg\n", tree_ns / SCHEMA_LOOPS);
+    printf("schema decode:   %llu ns/msg\n", schema_ns / SCHEMA_LOOPS);
+
+    json_struct_release(&message_schema, &back);
+    json_struct_release(&message_schema, &msg);
+    json_pool_drain();
+    free(expect);
+    free(buff);
+
+    return 0;
+}
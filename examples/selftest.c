@@ -288,7 +288,7 @@ static const char json_test[] = {
     "        \"c%d\": 2,"
     "        \"e^f\": 3,"
     "        \"g|h\": 4,"
-    "        \"i\\j\": 5,"
+    "        \"i\\\\j\": 5,"
     "        \"k\\\"l\": 6,"
     "        \" \": 7,"
     "        \"m~n\": 8"
@@ -300,7 +300,7 @@ static const char json_test[] = {
     "            {\"op\": \"test\", \"path\": \"/c%d\", \"value\": 2},"
     "            {\"op\": \"test\", \"path\": \"/e^f\", \"value\": 3},"
     "            {\"op\": \"test\", \"path\": \"/g|h\", \"value\": 4},"
-    "            {\"op\": \"test\", \"path\":  \"/i\\j\", \"value\": 5},"
+    "            {\"op\": \"test\", \"path\":  \"/i\\\\j\", \"value\": 5},"
     "            {\"op\": \"test\", \"path\": \"/k\\\"l\", \"value\": 6},"
     "            {\"op\": \"test\", \"path\": \"/ \", \"value\": 7},"
     "            {\"op\": \"test\", \"path\": \"/m~0n\", \"value\": 8}],"
@@ -315,10 +315,10 @@ static const char json_test[] = {
     "            \"baz\""
     "        ],"
     "        \"g|h\": 4,"
-    "        \"i\\j\": 5,"
+    "        \"i\\\\j\": 5,"
     "        \"k\\\"l\": 6,"
     "        \"m~n\": 8"
-    "    }"
+    "    }},"
 
     "{\"comment\": \"Move to same location has no effect\","
     "\"doc\": {\"foo\": 1},"
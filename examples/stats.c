@@ -0,0 +1,124 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2022 Sanpe <sanpeqf@gmail.com>
+ */
+
+#include "json.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+static const char *stats_types[] = {
+    "array", "object", "string", "number",
+    "null", "true", "false", "untyped",
+};
+
+static const char stats_test[] = {
+    "{\"service\": \"gateway\", \"version\": 3, \"healthy\": true,"
+    "\"upstreams\": [{\"host\": \"10.0.0.1\", \"port\": 8080, \"weight\": null},"
+    "{\"host\": \"10.0.0.2\", \"port\": 8081, \"weight\": 2}],"
+    "\"banner\": \"line one\\nline two\\twith a tab and a fairly long tail of text\","
+    "\"limits\": {\"rate\": [100, 200, 400], \"burst\": false}}"
+};
+
+#ifdef CONFIG_JSON_STATS
+static int stats_parse(struct json_stats *stats, const struct json_option *option)
+{
+    struct json_node *root;
+    int retval;
+
+    /* start every parse from an empty pool so their node allocations match */
+    json_pool_drain();
+    memset(stats, 0, sizeof(*stats));
+
+    json_stats_attach(stats);
+    retval = json_parse_option(stats_test, &root, option);
+    json_stats_attach(NULL);
+    if (!retval)
+        json_release(root);
+
+    return retval;
+}
+
+/* new keys are allocated by the intern table, known ones are not */
+static int stats_intern(void)
+{
+    struct json_stats fresh, known;
+    struct json_option option = {};
+    size_t memory;
+    int retval;
+
+    option.intern = json_intern_create();
+    if (!option.intern)
+        return -ENOMEM;
+
+    memory = json_intern_memory(option.intern);
+    retval = stats_parse(&fresh, &option);
+    if (!retval)
+        retval = stats_parse(&known, &option);
+
+    if (!retval && (fresh.alloc_count - known.alloc_count != json_intern_count(option.intern) ||
+        fresh.alloc_bytes - known.alloc_bytes != json_intern_memory(option.intern) - memory))
+        retval = -EINVAL;
+
+    json_intern_destroy(option.intern);
+    return retval;
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+    struct json_stats stats = {};
+    struct json_node *root;
+    unsigned int count;
+    char *buff;
+    int retval, length;
+
+#ifndef CONFIG_JSON_STATS
+    printf("statistics disabled, build with 'make JSON_STATS=1'\n");
+#endif
+
+    json_stats_attach(&stats);
+
+    retval = json_parse(stats_test, &root);
+    if (retval)
+        return retval;
+
+    length = json_encode(root, NULL, 0);
+    buff = malloc(length);
+    if (!buff) {
+        json_release(root);
+        return -ENOMEM;
+    }
+
+    json_encode(root, buff, length);
+    free(buff);
+    json_release(root);
+    json_stats_attach(NULL);
+
+    printf("parse bytes:      %llu\n", stats.parse_bytes);
+    printf("encode bytes:     %llu\n", stats.encode_bytes);
+    for (count = 0; count < ARRAY_SIZE(stats_types); ++count)
+        printf("%-8s nodes:   %llu\n", stats_types[count], stats.nodes[count]);
+    printf("max depth:        %u\n", stats.max_depth);
+    printf("tbuff reallocs:   %llu\n", stats.tbuff_reallocs);
+    printf("allocations:      %llu (%llu bytes)\n", stats.alloc_count, stats.alloc_bytes);
+    printf("pool hits:        %llu\n", stats.pool_hits);
+    printf("parse time:       %llu ns (%llu decoding strings)\n", stats.parse_ns, stats.decode_ns);
+    printf("encode time:      %llu ns\n", stats.encode_ns);
+    printf("release time:     %llu ns\n", stats.release_ns);
+
+    json_pool_drain();
+
+#ifdef CONFIG_JSON_STATS
+    /* the size probe wrote nothing and must not be counted */
+    if (stats.encode_bytes != (unsigned long long)length)
+        return -EINVAL;
+
+    retval = stats_intern();
+    if (retval)
+        return retval;
+#endif
+
+    return 0;
+}
@@ -0,0 +1,256 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2022 Sanpe <sanpeqf@gmail.com>
+ */
+
+#include "example.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#define STREAM_RECORDS  4000
+#define STREAM_DOCS     3
+#define STREAM_SNDBUF   4096
+
+static char *corpus_generate(unsigned int records, unsigned int seed)
+{
+    struct example_buff buff = {};
+    unsigned int count;
+
+    buff_printf(&buff, "[");
+    for (count = 0; count < records; ++count)
+        buff_printf(&buff,
+                    "%s{\"id\": %u, \"name\": \"node\\t%u\", \"up\": %s, \"tags\": [%u, null]}",
+                    count ? "," : "", count + seed, count, count & 1 ? "true" : "false", seed);
+    buff_printf(&buff, "]");
+
+    return buff.data;
+}
+
+static int set_nonblock(int fd)
+{
+    int flags = fcntl(fd, F_GETFL);
+    return flags < 0 ? -errno : fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+/* one poll loop drives both ends, neither side ever blocks */
+static int stream_documents(struct json_node **trees, char **expect, unsigned long *stalls)
+{
+    struct json_writer *writer = NULL;
+    struct json_parser *parser;
+    struct json_node *root;
+    unsigned int sent = 0, received = 0;
+    int fds[2], sndbuf = STREAM_SNDBUF;
+    struct pollfd pfds[2];
+    char *text;
+    int retval;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+        return -errno;
+
+    setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    if (set_nonblock(fds[0]) || set_nonblock(fds[1])) {
+        retval = -errno;
+        goto close;
+    }
+
+    parser = json_parser_create(NULL);
+    if (!parser) {
+        retval = -ENOMEM;
+        goto close;
+    }
+
+    while (received < STREAM_DOCS) {
+        pfds[0] = (struct pollfd) { .fd = fds[0], .events = sent < STREAM_DOCS ? POLLOUT : 0 };
+        pfds[1] = (struct pollfd) { .fd = fds[1], .events = POLLIN };
+        if (poll(pfds, 2, 1000) <= 0) {
+            retval = -ETIMEDOUT;
+            goto destroy;
+        }
+
+        if (pfds[0].revents & POLLOUT) {
+            if (!writer && !(writer = json_writer_create(trees[sent]))) {
+                retval = -ENOMEM;
+                goto destroy;
+            }
+            retval = json_writer_write(writer, fds[0]);
+            if (retval == -EAGAIN)
+                (*stalls)++;
+            else if (retval)
+                goto destroy;
+            else {
+                json_writer_destroy(writer);
+                writer = NULL;
+                /* the last document is told apart by the writer closing */
+                if (++sent == STREAM_DOCS)
+                    shutdown(fds[0], SHUT_WR);
+            }
+        }
+
+        if (pfds[1].revents & (POLLIN | POLLHUP)) {
+            while (received < STREAM_DOCS) {
+                retval = json_parser_read(parser, fds[1], &root);
+                if (retval == -EAGAIN)
+                    break;
+                else if (retval)
+                    goto destroy;
+
+                text = encode_alloc(root, NULL);
+                json_release(root);
+                if (!text || strcmp(text, expect[received])) {
+                    free(text);
+                    retval = -EBADMSG;
+                    goto destroy;
+                }
+                free(text);
+                received++;
+            }
+        }
+    }
+
+    retval = 0;
+
+destroy:
+    json_writer_destroy(writer);
+    json_parser_destroy(parser);
+close:
+    close(fds[0]);
+    close(fds[1]);
+    return retval;
+}
+
+static int feed_bytewise(const char *text, const char *expect)
+{
+    struct json_parser *parser;
+    struct json_node *root;
+    size_t offset, length;
+    char *result;
+    int retval;
+
+    parser = json_parser_create(NULL);
+    if (!parser)
+        return -ENOMEM;
+
+    length = strlen(text);
+    for (offset = 0; offset < length; ++offset) {
+        retval = json_parser_feed(parser, text + offset, 1);
+        if (retval < 0)
+            goto destroy;
+    }
+
+    retval = json_parser_finish(parser, &root);
+    if (retval)
+        goto destroy;
+
+    result = encode_alloc(root, NULL);
+    retval = result && !strcmp(result, expect) ? 0 : -EBADMSG;
+    json_release(root);
+    free(result);
+
+destroy:
+    json_parser_destroy(parser);
+    return retval;
+}
+
+/* a peer sends one document and waits, its end has to be visible */
+static int feed_pending(void)
+{
+    static const char *chunks[] = {"{\"a\": [1, ", "2]}"};
+    struct json_parser *parser;
+    struct json_node *root, *expect;
+    char *result = NULL, *text = NULL;
+    int retval;
+
+    parser = json_parser_create(NULL);
+    if (!parser)
+        return -ENOMEM;
+
+    retval = -EBADMSG;
+    if (json_parser_feed(parser, chunks[0], strlen(chunks[0])) != (ssize_t)strlen(chunks[0]) ||
+        json_parser_done(parser) || json_parser_finish(parser, &root) != -EAGAIN)
+        goto destroy;
+
+    /* finish kept the open document, the rest completes it */
+    if (json_parser_feed(parser, chunks[1], strlen(chunks[1])) != (ssize_t)strlen(chunks[1]) ||
+        !json_parser_done(parser))
+        goto destroy;
+
+    retval = json_parser_finish(parser, &root);
+    if (retval)
+        goto destroy;
+
+    retval = json_parse("{\"a\": [1, 2]}", &expect);
+    if (!retval) {
+        result = encode_alloc(root, NULL);
+        text = encode_alloc(expect, NULL);
+        retval = result && text && !strcmp(result, text) ? 0 : -EBADMSG;
+        json_release(expect);
+    }
+
+    json_release(root);
+    free(result);
+    free(text);
+
+destroy:
+    json_parser_destroy(parser);
+    return retval;
+}
+
+int main(int argc, char *argv[])
+{
+    struct json_node *trees[STREAM_DOCS] = {};
+    char *corpus[STREAM_DOCS] = {}, *expect[STREAM_DOCS] = {};
+    unsigned long stalls = 0;
+    unsigned int count;
+    int retval = -ENOMEM;
+
+    for (count = 0; count < STREAM_DOCS; ++count) {
+        corpus[count] = corpus_generate(STREAM_RECORDS, count);
+        if (!corpus[count])
+            goto finish;
+        retval = json_parse(corpus[count], &trees[count]);
+        if (retval)
+            goto finish;
+        expect[count] = encode_alloc(trees[count], NULL);
+        if (!expect[count]) {
+            retval = -ENOMEM;
+            goto finish;
+        }
+    }
+
+    retval = feed_bytewise(corpus[0], expect[0]);
+    if (retval) {
+        printf("bytewise feed failed: %d\n", retval);
+        goto finish;
+    }
+
+    retval = feed_pending();
+    if (retval) {
+        printf("pending feed failed: %d\n", retval);
+        goto finish;
+    }
+
+    retval = stream_documents(trees, expect, &stalls);
+    if (retval) {
+        printf("stream failed: %d\n", retval);
+        goto finish;
+    }
+
+    printf("documents:       %u\n", STREAM_DOCS);
+    printf("bytes each:      %zu\n", strlen(expect[0]));
+    printf("writer stalls:   %lu\n", stalls);
+
+    /* a small socket buffer has to push back, or nothing was resumed */
+    retval = stalls ? 0 : -EAGAIN;
+
+finish:
+    for (count = 0; count < STREAM_DOCS; ++count) {
+        json_release(trees[count]);
+        free(expect[count]);
+        free(corpus[count]);
+    }
+
+    json_pool_drain();
+    return -retval;
+}
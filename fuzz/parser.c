@@ -0,0 +1,980 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2022 Sanpe <sanpeqf@gmail.com>
+ */
+
+#include "json.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
+
+#define FUZZ_INPUT_MAX  (1 << 20)
+#define FUZZ_DEPTH_MAX  30
+
+#define fuzz_assert(cond) do {                                          \
+    if (!(cond)) {                                                      \
+        fprintf(stderr, "fuzz: %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        abort();                                                        \
+    }                                                                   \
+} while (0)
+
+static bool tree_equal(struct json_node *a, struct json_node *b)
+{
+    struct json_node *ca, *cb;
+
+    if ((a->flags & JSON_STATS_MASK) != (b->flags & JSON_STATS_MASK))
+        return false;
+
+    if (a->parent && json_test_object(a->parent) && strcmp(a->name, b->name))
+        return false;
+
+    if (json_test_string(a))
+        return !strcmp(a->string, b->string);
+    if (json_test_number(a))
+        return a->number == b->number;
+    if (!json_test_array(a) && !json_test_object(a))
+        return true;
+
+    cb = list_first_entry(&b->child, struct json_node, sibling);
+    list_for_each_entry(ca, &a->child, sibling) {
+        if (&cb->sibling == &b->child || !tree_equal(ca, cb))
+            return false;
+        cb = list_next_entry(cb, sibling);
+    }
+
+    return &cb->sibling == &b->child;
+}
+
+static char *encode_alloc(struct json_node *root)
+{
+    char *buff, *short_buff;
+    int length, short_size;
+
+    length = json_encode(root, NULL, 0);
+    buff = malloc(length);
+    fuzz_assert(buff);
+    fuzz_assert(json_encode(root, buff, length) == length);
+    fuzz_assert(strlen(buff) + 1 == (size_t)length);
+
+    /* a short buffer holds a terminated prefix, like snprintf() */
+    short_buff = malloc(length);
+    fuzz_assert(short_buff);
+    short_size = length / 2;
+    memset(short_buff, 'x', length);
+    fuzz_assert(json_encode(root, short_buff, short_size) == length);
+    if (short_size) {
+        fuzz_assert(strlen(short_buff) == (size_t)short_size - 1);
+        fuzz_assert(!memcmp(short_buff, buff, short_size - 1));
+    } else
+        fuzz_assert(short_buff[0] == 'x');
+    free(short_buff);
+
+    return buff;
+}
+
+/* Byte-at-a-time reference for json_escape(). */
+static size_t escape_reference(char *buff, const char *string)
+{
+    static const char hex[] = "0123456789abcdef";
+    unsigned char value;
+    char *walk = buff;
+
+    while ((value = *string++)) {
+        switch (value) {
+            case '"':  walk += sprintf(walk, "\\\""); break;
+            case '\\': walk += sprintf(walk, "\\\\"); break;
+            case '\b': walk += sprintf(walk, "\\b");  break;
+            case '\f': walk += sprintf(walk, "\\f");  break;
+            case '\n': walk += sprintf(walk, "\\n");  break;
+            case '\r': walk += sprintf(walk, "\\r");  break;
+            case '\t': walk += sprintf(walk, "\\t");  break;
+            default:
+                if (value < 0x20)
+                    walk += sprintf(walk, "\\u00%c%c", hex[value >> 4], hex[value & 0xf]);
+                else
+                    *walk++ = value;
+        }
+    }
+
+    *walk = '\0';
+    return walk - buff;
+}
+
+/* Byte-at-a-time reference for json_utf8_check(). */
+static bool utf8_reference(const unsigned char *string, size_t length)
+{
+    size_t offset = 0, count, index;
+    uint32_t code;
+
+    while (offset < length) {
+        code = string[offset];
+        if (code < 0x80)
+            count = 0;
+        else if ((code & 0xe0) == 0xc0)
+            count = 1, code &= 0x1f;
+        else if ((code & 0xf0) == 0xe0)
+            count = 2, code &= 0x0f;
+        else if ((code & 0xf8) == 0xf0)
+            count = 3, code &= 0x07;
+        else
+            return false;
+
+        if (offset + count >= length && count)
+            return false;
+
+        for (index = 1; index <= count; ++index) {
+            if ((string[offset + index] & 0xc0) != 0x80)
+                return false;
+            code = code << 6 | (string[offset + index] & 0x3f);
+        }
+
+        if ((count == 1 && code < 0x80) || (count == 2 && code < 0x800) ||
+            (count == 3 && code < 0x10000) || code > 0x10ffff ||
+            (code >= 0xd800 && code <= 0xdfff))
+            return false;
+
+        offset += count + 1;
+    }
+
+    return true;
+}
+
+/*
+ * Strict reference for what json_parse() accepts: RFC 8259 with integer
+ * numbers that fit a long and no NUL inside strings. Nesting beyond
+ * FUZZ_DEPTH_MAX is left undecided since the parser has its own limit.
+ */
+struct valid_ctx {
+    const unsigned char *walk;
+    unsigned int depth, max;
+};
+
+static void valid_space(struct valid_ctx *ctx)
+{
+    while (*ctx->walk == ' ' || *ctx->walk == '\t' ||
+           *ctx->walk == '\n' || *ctx->walk == '\r')
+        ctx->walk++;
+}
+
+static int valid_hex(const unsigned char *walk)
+{
+    int value = 0, count;
+
+    for (count = 0; count < 4; ++count) {
+        if (walk[count] >= '0' && walk[count] <= '9')
+            value = value << 4 | (walk[count] - '0');
+        else if ((walk[count] | 0x20) >= 'a' && (walk[count] | 0x20) <= 'f')
+            value = value << 4 | ((walk[count] | 0x20) - 'a' + 10);
+        else
+            return -1;
+    }
+
+    return value;
+}
+
+static bool valid_string(struct valid_ctx *ctx)
+{
+    const unsigned char *start = ++ctx->walk;
+    int code, low;
+
+    for (;;) {
+        if (*ctx->walk == '"') {
+            /* escapes are ASCII, so the raw bytes decide UTF-8 validity */
+            if (!utf8_reference(start, ctx->walk - start))
+                return false;
+            ctx->walk++;
+            return true;
+        } else if (*ctx->walk < 0x20) {
+            return false;
+        } else if (*ctx->walk != '\\') {
+            ctx->walk++;
+            continue;
+        }
+
+        ctx->walk++;
+        if (*ctx->walk && strchr("\"\\/bfnrt", *ctx->walk)) {
+            ctx->walk++;
+            continue;
+        } else if (*ctx->walk != 'u')
+            return false;
+
+        code = valid_hex(ctx->walk + 1);
+        if (code <= 0 || (code >= 0xdc00 && code <= 0xdfff))
+            return false;
+        ctx->walk += 5;
+
+        if (code >= 0xd800 && code <= 0xdbff) {
+            if (ctx->walk[0] != '\\' || ctx->walk[1] != 'u')
+                return false;
+            low = valid_hex(ctx->walk + 2);
+            if (low < 0xdc00 || low > 0xdfff)
+                return false;
+            ctx->walk += 6;
+        }
+    }
+}
+
+static bool valid_number(struct valid_ctx *ctx)
+{
+    const char *start = (const char *)ctx->walk;
+
+    if (*ctx->walk == '-')
+        ctx->walk++;
+
+    if (*ctx->walk == '0')
+        ctx->walk++;
+    else if (*ctx->walk >= '1' && *ctx->walk <= '9') {
+        while (*ctx->walk >= '0' && *ctx->walk <= '9')
+            ctx->walk++;
+    } else
+        return false;
+
+    errno = 0;
+    strtol(start, NULL, 10);
+    return errno != ERANGE;
+}
+
+static bool valid_word(struct valid_ctx *ctx, const char *word)
+{
+    size_t length = strlen(word);
+
+    if (strncmp((const char *)ctx->walk, word, length))
+        return false;
+
+    ctx->walk += length;
+    return true;
+}
+
+static bool valid_value(struct valid_ctx *ctx);
+
+static bool valid_container(struct valid_ctx *ctx)
+{
+    bool object = *ctx->walk == '{';
+    char close = object ? '}' : ']';
+
+    ctx->max = max(ctx->max, ++ctx->depth);
+    if (ctx->depth > FUZZ_DEPTH_MAX)
+        return false;
+
+    ctx->walk++;
+    valid_space(ctx);
+    if (*ctx->walk == close)
+        goto finish;
+
+    for (;;) {
+        if (object) {
+            valid_space(ctx);
+            if (*ctx->walk != '"' || !valid_string(ctx))
+                return false;
+            valid_space(ctx);
+            if (*ctx->walk != ':')
+                return false;
+            ctx->walk++;
+        }
+
+        if (!valid_value(ctx))
+            return false;
+
+        valid_space(ctx);
+        if (*ctx->walk == close)
+            break;
+        if (*ctx->walk != ',')
+            return false;
+        ctx->walk++;
+    }
+
+finish:
+    ctx->walk++;
+    ctx->depth--;
+    return true;
+}
+
+static bool valid_value(struct valid_ctx *ctx)
+{
+    valid_space(ctx);
+
+    switch (*ctx->walk) {
+        case '[': case '{':
+            return valid_container(ctx);
+
+        case '"':
+            return valid_string(ctx);
+
+        case 't':
+            return valid_word(ctx, "true");
+
+        case 'f':
+            return valid_word(ctx, "false");
+
+        case 'n':
+            return valid_word(ctx, "null");
+
+        default:
+            return valid_number(ctx);
+    }
+}
+
+static bool valid_document(const char *text, unsigned int *depth)
+{
+    struct valid_ctx ctx = {(const unsigned char *)text, 0, 0};
+    bool valid;
+
+    valid = valid_value(&ctx);
+    if (valid) {
+        valid_space(&ctx);
+        valid = !*ctx.walk;
+    }
+
+    *depth = ctx.max;
+    return valid;
+}
+
+static void check_strings(struct json_node *node)
+{
+    struct json_node *child;
+    char *expect, *result;
+    size_t length;
+    int escaped;
+
+    if (json_test_string(node)) {
+        length = strlen(node->string);
+        expect = malloc(length * 6 + 1);
+        result = malloc(length * 6 + 1);
+        fuzz_assert(expect && result);
+
+        escaped = json_escape(result, length * 6 + 1, node->string);
+        fuzz_assert((size_t)escaped == escape_reference(expect, node->string));
+        fuzz_assert(!strcmp(expect, result));
+
+        /* a short buffer still reports the full length and is terminated */
+        memset(result, 'x', length * 6 + 1);
+        fuzz_assert(json_escape(result, length / 2, node->string) == escaped);
+        if (length / 2) {
+            fuzz_assert(strlen(result) == length / 2 - 1);
+            fuzz_assert(!memcmp(result, expect, length / 2 - 1));
+        } else
+            fuzz_assert(result[0] == 'x');
+
+        free(expect);
+        free(result);
+    } else if (json_test_array(node) || json_test_object(node)) {
+        list_for_each_entry(child, &node->child, sibling)
+            check_strings(child);
+    }
+}
+
+static void check_compact(struct json_node *root)
+{
+    struct json_compact compact, loaded;
+    struct json_node *expand;
+    size_t size;
+    void *image;
+
+    if (json_compact_build(&compact, root))
+        return;
+
+    fuzz_assert(!json_compact_expand(&compact, 0, &expand));
+    fuzz_assert(tree_equal(root, expand));
+    json_release(expand);
+
+    size = json_compact_save(&compact, NULL, 0);
+    image = malloc(size);
+    fuzz_assert(image);
+    json_compact_save(&compact, image, size);
+
+    fuzz_assert(!json_compact_load(&loaded, image, size));
+    fuzz_assert(!json_compact_expand(&loaded, 0, &expand));
+    fuzz_assert(tree_equal(root, expand));
+    json_release(expand);
+    json_compact_release(&loaded);
+
+    free(image);
+    json_compact_release(&compact);
+}
+
+/* the same text fed in small pieces must end exactly like one call */
+static void check_chunked(const char *text, int expect, struct json_node *root, size_t step)
+{
+    struct json_parser *parser;
+    struct json_node *chunked;
+    size_t length, piece, offset = 0;
+    int retval = 0;
+
+    parser = json_parser_create(NULL);
+    fuzz_assert(parser);
+
+    length = strlen(text);
+    while (offset < length) {
+        piece = min(step, length - offset);
+        retval = json_parser_feed(parser, text + offset, piece);
+        if (retval < 0)
+            break;
+        offset += retval;
+        if ((size_t)retval < piece) {
+            fuzz_assert(json_parser_done(parser));
+            break;
+        }
+    }
+
+    /* feed stops after the document, the one-shot parse refuses the rest */
+    if (retval >= 0 && text[offset + strspn(text + offset, " \t\n\r")])
+        retval = -EINVAL;
+    else if (retval >= 0)
+        retval = json_parser_finish(parser, &chunked);
+
+    /* a document left open is kept, the one-shot parse calls it truncated */
+    if (retval == -EAGAIN) {
+        fuzz_assert(!json_parser_done(parser));
+        fuzz_assert(json_parser_finish(parser, &chunked) == -EAGAIN);
+        retval = -EINVAL;
+    }
+
+    fuzz_assert(retval == expect);
+    if (!retval) {
+        fuzz_assert(tree_equal(root, chunked));
+        json_release(chunked);
+    }
+
+    json_parser_destroy(parser);
+}
+
+/* one reusing parser lives across all inputs, recycling every tree */
+static void check_reuse(const char *text, int expect, struct json_node *root)
+{
+    static struct json_parser *parser;
+    struct json_node *reused;
+    int retval;
+
+    if (!parser)
+        parser = json_parser_create_reuse(NULL);
+    fuzz_assert(parser);
+
+    retval = json_parser_parse(parser, text, &reused);
+    fuzz_assert(retval == expect);
+    if (!retval) {
+        fuzz_assert(tree_equal(root, reused));
+        fuzz_assert(!json_parser_recycle(parser, reused));
+    }
+}
+
+static void check_writer(struct json_node *root, const char *expect, int step)
+{
+    struct json_writer *writer;
+    size_t length = 0, total;
+    char *buff;
+    int retval;
+
+    total = strlen(expect);
+    buff = malloc(total + step);
+    writer = json_writer_create(root);
+    fuzz_assert(buff && writer);
+
+    while ((retval = json_writer_fill(writer, buff + length, step)) > 0) {
+        length += retval;
+        fuzz_assert(length <= total);
+    }
+
+    fuzz_assert(!retval && length == total);
+    fuzz_assert(!memcmp(buff, expect, total));
+
+    json_writer_destroy(writer);
+    free(buff);
+}
+
+/* slow model of the duplicate key policies, applied to an appended tree */
+static bool dedup_reference(struct json_node *parent, enum json_dupkey dupkey)
+{
+    struct json_node *child, *other, *tmp;
+    bool found = false;
+
+    if (!json_test_array(parent) && !json_test_object(parent))
+        return false;
+
+    list_for_each_entry_safe(child, tmp, &parent->child, sibling) {
+        if (!json_test_object(parent))
+            break;
+        for (other = list_next_entry(child, sibling); &other->sibling != &parent->child;
+             other = list_next_entry(other, sibling)) {
+            if (strcmp(child->name, other->name))
+                continue;
+            found = true;
+            if (dupkey == JSON_DUPKEY_LAST) {
+                json_remove(child);
+                break;
+            }
+        }
+    }
+
+    if (dupkey == JSON_DUPKEY_FIRST && json_test_object(parent)) {
+        list_for_each_entry_safe(child, tmp, &parent->child, sibling) {
+            for (other = list_first_entry(&parent->child, struct json_node, sibling);
+                 other != child; other = list_next_entry(other, sibling)) {
+                if (!strcmp(child->name, other->name)) {
+                    json_remove(child);
+                    break;
+                }
+            }
+        }
+    }
+
+    list_for_each_entry(child, &parent->child, sibling)
+        found |= dedup_reference(child, dupkey);
+
+    return found;
+}
+
+static void check_dupkey(const char *text)
+{
+    struct json_option option = {};
+    struct json_node *expect, *result;
+    enum json_dupkey dupkey;
+    bool duplicated;
+
+    for (dupkey = JSON_DUPKEY_FIRST; dupkey <= JSON_DUPKEY_ERROR; ++dupkey) {
+        fuzz_assert(!json_parse(text, &expect));
+        duplicated = dedup_reference(expect, dupkey);
+
+        option.dupkey = dupkey;
+        if (dupkey == JSON_DUPKEY_ERROR) {
+            fuzz_assert(json_parse_option(text, &result, &option) == (duplicated ? -EEXIST : 0));
+            if (!duplicated)
+                json_release(result);
+        } else {
+            fuzz_assert(!json_parse_option(text, &result, &option));
+            fuzz_assert(tree_equal(expect, result));
+            json_release(result);
+        }
+
+        json_release(expect);
+    }
+}
+
+/* compact output parses back to the same tree, sorted output is stable */
+static void check_options(struct json_node *root)
+{
+    struct json_option option = {};
+    struct json_node *again;
+    char *first, *second;
+    int length;
+
+    option.encode = JSON_ENCODE_COMPACT;
+    length = json_encode_option(root, NULL, 0, &option);
+    first = malloc(length);
+    fuzz_assert(first);
+    fuzz_assert(json_encode_option(root, first, length, &option) == length);
+    fuzz_assert(strlen(first) + 1 == (size_t)length && !strpbrk(first, "\n\t"));
+    fuzz_assert(!json_parse(first, &again));
+    fuzz_assert(tree_equal(root, again));
+    json_release(again);
+    free(first);
+
+    option.encode = JSON_ENCODE_SORTED | JSON_ENCODE_COMPACT;
+    length = json_encode_option(root, NULL, 0, &option);
+    first = malloc(length);
+    fuzz_assert(first);
+    json_encode_option(root, first, length, &option);
+    fuzz_assert(!json_parse(first, &again));
+    length = json_encode_option(again, NULL, 0, &option);
+    second = malloc(length);
+    fuzz_assert(second);
+    json_encode_option(again, second, length, &option);
+    fuzz_assert(!strcmp(first, second));
+    json_release(again);
+    free(second);
+    free(first);
+}
+
+struct fuzz_inner {
+    int8_t small;
+    uint16_t port;
+    bool flag;
+    uint64_t wide;
+};
+
+struct fuzz_record {
+    int64_t id;
+    char *name;
+    struct fuzz_inner inner;
+    char tag[8];
+};
+
+/* keys match what fuzz_value() generates */
+static JSON_SCHEMA(fuzz_inner_schema, struct fuzz_inner,
+    JSON_FIELD_NAMED("k0", struct fuzz_inner, small, JSON_FTYPE_INT),
+    JSON_FIELD_NAMED("k1", struct fuzz_inner, port, JSON_FTYPE_UINT),
+    JSON_FIELD_NAMED("k2", struct fuzz_inner, flag, JSON_FTYPE_BOOL),
+    JSON_FIELD_NAMED("k3", struct fuzz_inner, wide, JSON_FTYPE_UINT),
+);
+
+static JSON_SCHEMA(fuzz_record_schema, struct fuzz_record,
+    JSON_FIELD_NAMED("k0", struct fuzz_record, id, JSON_FTYPE_INT),
+    JSON_FIELD_NAMED("k1", struct fuzz_record, name, JSON_FTYPE_STRING),
+    { .name = "k2", .type = JSON_FTYPE_OBJECT, .offset = offsetof(struct fuzz_record, inner),
+      .size = sizeof(struct fuzz_inner), .schema = &fuzz_inner_schema },
+    JSON_FIELD_NAMED("k3", struct fuzz_record, tag, JSON_FTYPE_BUFFER),
+);
+
+/* Tree walking reference for json_struct_decode(), members applied in order. */
+static int struct_reference(struct json_schema *schema, struct json_node *node, void *object)
+{
+    const struct json_field *field;
+    struct json_node *child;
+    unsigned int count;
+    long long low, high;
+    void *member;
+    int retval;
+
+    if (!json_test_object(node))
+        return -EINVAL;
+
+    list_for_each_entry(child, &node->child, sibling) {
+        for (count = 0; count < schema->count; ++count) {
+            if (!strcmp(schema->fields[count].name, child->name))
+                break;
+        }
+        if (count == schema->count)
+            continue;
+
+        field = &schema->fields[count];
+        member = (char *)object + field->offset;
+        switch (field->type) {
+            case JSON_FTYPE_BOOL:
+                if (!json_test_true(child) && !json_test_false(child))
+                    return -EINVAL;
+                *(bool *)member = json_test_true(child);
+                break;
+
+            case JSON_FTYPE_INT: case JSON_FTYPE_UINT:
+                if (!json_test_number(child))
+                    return -EINVAL;
+                high = field->size == 8 ? LLONG_MAX : (1LL << (field->size * 8 - 1)) - 1;
+                low = -high - 1;
+                if (field->type == JSON_FTYPE_UINT) {
+                    high = field->size == 8 ? LLONG_MAX : high * 2 + 1;
+                    low = 0;
+                }
+                if (child->number < low || child->number > high)
+                    return -ERANGE;
+                switch (field->size) {
+                    case 1: *(int8_t *)member = child->number; break;
+                    case 2: *(int16_t *)member = child->number; break;
+                    case 4: *(int32_t *)member = child->number; break;
+                    default: *(int64_t *)member = child->number; break;
+                }
+                break;
+
+            case JSON_FTYPE_STRING:
+                if (!json_test_null(child) && !json_test_string(child))
+                    return -EINVAL;
+                free(*(char **)member);
+                *(char **)member = json_test_null(child) ? NULL : strdup(child->string);
+                break;
+
+            case JSON_FTYPE_BUFFER:
+                if (!json_test_string(child))
+                    return -EINVAL;
+                if (strlen(child->string) >= field->size)
+                    return -ENOSPC;
+                strcpy(member, child->string);
+                break;
+
+            case JSON_FTYPE_OBJECT:
+                retval = struct_reference(field->schema, child, member);
+                if (retval)
+                    return retval;
+                break;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * The struct decoder must accept exactly the objects json_parse() does and
+ * fill in the same members. Numbers past a long only fit the decoder's
+ * uint64 members and nesting limits differ, so those inputs are skipped.
+ */
+static void check_schema(const char *text, int expect, struct json_node *root)
+{
+    struct fuzz_record decoded = {}, reference = {};
+    int retval;
+
+    retval = json_struct_decode(&fuzz_record_schema, text, &decoded);
+    if (expect == -ERANGE || expect == -EOVERFLOW || retval == -EOVERFLOW)
+        goto finish;
+
+    if (expect) {
+        fuzz_assert(retval);
+        goto finish;
+    }
+
+    fuzz_assert(retval == struct_reference(&fuzz_record_schema, root, &reference));
+    if (retval)
+        goto finish;
+
+    fuzz_assert(decoded.id == reference.id);
+    fuzz_assert(!decoded.name == !reference.name);
+    fuzz_assert(!decoded.name || !strcmp(decoded.name, reference.name));
+    fuzz_assert(decoded.inner.small == reference.inner.small);
+    fuzz_assert(decoded.inner.port == reference.inner.port);
+    fuzz_assert(decoded.inner.flag == reference.inner.flag);
+    fuzz_assert(decoded.inner.wide == reference.inner.wide);
+    fuzz_assert(!strcmp(decoded.tag, reference.tag));
+
+finish:
+    json_struct_release(&fuzz_record_schema, &decoded);
+    json_struct_release(&fuzz_record_schema, &reference);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    struct json_node *root = NULL, *again;
+    char *text, *first, *second;
+    unsigned int depth;
+    bool valid;
+    int retval;
+
+    if (size > FUZZ_INPUT_MAX)
+        return 0;
+
+    fuzz_assert(!json_utf8_check((const char *)data, size) == utf8_reference(data, size));
+
+    text = malloc(size + 1);
+    fuzz_assert(text);
+    memcpy(text, data, size);
+    text[size] = '\0';
+
+    retval = json_parse(text, &root);
+    valid = valid_document(text, &depth);
+    fuzz_assert(retval ? !valid || depth >= FUZZ_DEPTH_MAX : valid);
+
+    check_chunked(text, retval, root, size % 7 + 1);
+    check_reuse(text, retval, root);
+    check_schema(text, retval, root);
+    if (retval) {
+        free(text);
+        return 0;
+    }
+
+    /* parse -> encode -> parse must be a fixed point */
+    first = encode_alloc(root);
+    fuzz_assert(!json_parse(first, &again));
+    fuzz_assert(tree_equal(root, again));
+    second = encode_alloc(again);
+    fuzz_assert(!strcmp(first, second));
+
+    check_writer(root, first, size % 13 + 1);
+    check_dupkey(text);
+    check_options(root);
+    check_strings(root);
+    check_compact(root);
+
+    free(second);
+    free(first);
+    json_release(again);
+    json_release(root);
+    free(text);
+
+    return 0;
+}
+
+#ifndef JSON_LIBFUZZER
+
+static unsigned int fuzz_seed;
+
+static unsigned int fuzz_rand(void)
+{
+    fuzz_seed = fuzz_seed * 1103515245U + 12345U;
+    return fuzz_seed >> 8;
+}
+
+static const char *fuzz_tokens[] = {
+    "null", "true", "false", "0", "-1", "42", "9223372036854775807", "1.5",
+    "\"\"", "\"a\"", "\"\\n\\t\\\"\"", "\"\\u00e9\\ud83d\\ude00\"", "\"\\u0001\"",
+    "\"\xc3\xa9\"", "\"\xff\"", "\"\\x\"", "\"\\ud800\"", "  ", "\n", ",", ":",
+    "[", "]", "{", "}", "\"key\":", "tru", "-", "\"\\", "\"unterminated",
+    "01", "1e5", "-0", "9223372036854775808", "\"\x01\"", " x", "\t",
+};
+
+static const char fuzz_soup[] = "[]{},:\"\\a1 -0.etnu";
+
+static size_t fuzz_value(char *buff, size_t size, unsigned int depth)
+{
+    size_t len = 0;
+    unsigned int count, items;
+
+    switch (depth > 6 ? fuzz_rand() % 3 : fuzz_rand() % 5) {
+        case 0: case 1: case 2:
+            return snprintf(buff, size, "%s", fuzz_tokens[fuzz_rand() % 16]);
+
+        case 3:
+            items = fuzz_rand() % 5;
+            len += snprintf(buff + len, size - len, "[");
+            for (count = 0; count < items && len < size; ++count) {
+                if (count)
+                    len += snprintf(buff + len, size - len, ", ");
+                len += fuzz_value(buff + len, size - len, depth + 1);
+            }
+            return len + snprintf(buff + len, size - len, "]");
+
+        default:
+            items = fuzz_rand() % 5;
+            len += snprintf(buff + len, size - len, "{");
+            for (count = 0; count < items && len < size; ++count) {
+                len += snprintf(buff + len, size - len, "%s\"k%u\": ",
+                                count ? ", " : "", fuzz_rand() % 4);
+                len += fuzz_value(buff + len, size - len, depth + 1);
+            }
+            return len + snprintf(buff + len, size - len, "}");
+    }
+}
+
+static const char *fuzz_numbers[] = {
+    "0", "-0", "1", "-1", "127", "128", "-128", "-129", "65535", "65536",
+    "9223372036854775807", "-9223372036854775808", "9223372036854775808",
+    "18446744073709551615", "18446744073709551616", "1.5", "1e3", "01",
+};
+
+/* objects shaped like the fuzz schema, with numbers near its edges */
+static size_t fuzz_record(char *buff, size_t size, unsigned int depth)
+{
+    size_t len = 0;
+    unsigned int count, items;
+
+    items = fuzz_rand() % 6;
+    len += snprintf(buff + len, size - len, "{");
+    for (count = 0; count < items && len < size; ++count) {
+        len += snprintf(buff + len, size - len, "%s\"k%u\": ",
+                        count ? ", " : "", fuzz_rand() % 5);
+        switch (fuzz_rand() % 5) {
+            case 0: case 1:
+                len += snprintf(buff + len, size - len, "%s",
+                                fuzz_numbers[fuzz_rand() % ARRAY_SIZE(fuzz_numbers)]);
+                break;
+
+            case 2:
+                if (!depth) {
+                    len += fuzz_record(buff + len, size - len, depth + 1);
+                    break;
+                }
+                /* fallthrough */
+
+            default:
+                len += fuzz_value(buff + len, size - len, 7);
+                break;
+        }
+    }
+
+    return len + snprintf(buff + len, size - len, "}");
+}
+
+static void fuzz_random(unsigned long rounds, unsigned int seed)
+{
+    char buff[8192];
+    unsigned int count, mutate;
+    size_t len;
+
+    fuzz_seed = seed;
+    while (rounds--) {
+        /* short soups of JSON punctuation probe the grammar's edges */
+        if (fuzz_rand() % 4 == 0) {
+            len = fuzz_rand() % 12 + 1;
+            for (count = 0; count < len; ++count)
+                buff[count] = fuzz_soup[fuzz_rand() % (sizeof(fuzz_soup) - 1)];
+            LLVMFuzzerTestOneInput((const uint8_t *)buff, len);
+            continue;
+        }
+
+        if (fuzz_rand() % 3 == 0)
+            len = fuzz_record(buff, sizeof(buff) - 64, 0);
+        else
+            len = fuzz_value(buff, sizeof(buff) - 64, 0);
+        len = min(len, sizeof(buff) - 64);
+
+        /* splice a few raw tokens or bytes in to leave the happy path */
+        mutate = fuzz_rand() % 4;
+        for (count = 0; count < mutate && len; ++count) {
+            size_t pos = fuzz_rand() % len;
+            if (fuzz_rand() & 1)
+                buff[pos] = fuzz_rand() & 0xff;
+            else {
+                const char *token = fuzz_tokens[fuzz_rand() % ARRAY_SIZE(fuzz_tokens)];
+                size_t tlen = min(strlen(token), sizeof(buff) - 1 - len);
+                memmove(buff + pos + tlen, buff + pos, len - pos);
+                memcpy(buff + pos, token, tlen);
+                len += tlen;
+            }
+        }
+
+        LLVMFuzzerTestOneInput((const uint8_t *)buff, len);
+    }
+}
+
+static int fuzz_file(FILE *file)
+{
+    uint8_t *buff;
+    size_t size;
+
+    buff = malloc(FUZZ_INPUT_MAX);
+    if (!buff)
+        return -ENOMEM;
+
+    size = fread(buff, 1, FUZZ_INPUT_MAX, file);
+    LLVMFuzzerTestOneInput(buff, size);
+    free(buff);
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long rounds = 0;
+    unsigned int seed = 1;
+    int opt, index, retval;
+    FILE *file;
+
+    while ((opt = getopt(argc, argv, "r:s:")) != -1) {
+        switch (opt) {
+            case 'r':
+                rounds = strtoul(optarg, NULL, 0);
+                break;
+
+            case 's':
+                seed = strtoul(optarg, NULL, 0);
+                break;
+
+            default:
+                fprintf(stderr, "usage: %s [-r rounds] [-s seed] [file...]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (rounds) {
+        fuzz_random(rounds, seed);
+        printf("fuzz: %lu random inputs ok\n", rounds);
+    }
+
+    for (index = optind; index < argc; ++index) {
+        file = fopen(argv[index], "rb");
+        if (!file) {
+            perror(argv[index]);
+            return 1;
+        }
+        retval = fuzz_file(file);
+        fclose(file);
+        if (retval)
+            return 1;
+    }
+
+    /* AFL style: one input on stdin */
+    if (!rounds && optind == argc)
+        return fuzz_file(stdin) ? 1 : 0;
+
+    json_pool_drain();
+    return 0;
+}
+
+#endif  /* JSON_LIBFUZZER */
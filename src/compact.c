@@ -0,0 +1,457 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2022 Sanpe <sanpeqf@gmail.com>
+ */
+
+#include "json.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define COMPACT_DEPTH_MAX   4096
+
+_Static_assert(sizeof(struct json_centry) == 16, "compact entry must stay 16 bytes");
+
+struct compact_build {
+    struct json_compact *compact;
+    uint32_t epos, ppos;
+};
+
+static inline bool is_inline(size_t length)
+{
+    return length < JSON_CENTRY_INLINE_MAX;
+}
+
+static int compact_measure(struct json_node *node, bool named, size_t *entries, size_t *pool)
+{
+    struct json_node *child;
+    size_t length;
+    int retval;
+
+    if (named) {
+        length = node->name ? strlen(node->name) : 0;
+        *entries += 1;
+        if (!is_inline(length))
+            *pool += length + 1;
+    }
+
+    *entries += 1;
+    if (json_test_string(node)) {
+        length = strlen(node->string);
+        if (!is_inline(length))
+            *pool += length + 1;
+    }
+
+    /* entry indices and pool offsets are stored as 32 bits */
+    if (*entries > UINT32_MAX || *pool > UINT32_MAX)
+        return -EOVERFLOW;
+
+    if (json_test_array(node) || json_test_object(node)) {
+        list_for_each_entry(child, &node->child, sibling) {
+            retval = compact_measure(child, json_test_object(node), entries, pool);
+            if (retval)
+                return retval;
+        }
+    }
+
+    return 0;
+}
+
+static void compact_text(struct compact_build *build, struct json_centry *entry,
+                         unsigned int type, const char *text)
+{
+    size_t length = strlen(text);
+
+    if (is_inline(length)) {
+        entry->info = type | JSON_CENTRY_INLINE;
+        memcpy(entry->text, text, length + 1);
+        return;
+    }
+
+    entry->info = type;
+    entry->str.offset = build->ppos;
+    entry->str.length = length;
+    memcpy(build->compact->pool + build->ppos, text, length + 1);
+    build->ppos += length + 1;
+}
+
+static uint32_t compact_fill(struct compact_build *build, struct json_node *node, bool named)
+{
+    struct json_centry *entry, *prev = NULL;
+    struct json_node *child;
+    uint32_t index, cindex;
+
+    if (named) {
+        entry = &build->compact->entries[build->epos++];
+        memset(entry, 0, sizeof(*entry));
+        compact_text(build, entry, JSON_CTYPE_KEY, node->name ? node->name : "");
+    }
+
+    index = build->epos++;
+    entry = &build->compact->entries[index];
+    memset(entry, 0, sizeof(*entry));
+
+    if (json_test_array(node) || json_test_object(node)) {
+        entry->info = json_test_object(node) ? JSON_CTYPE_OBJECT : JSON_CTYPE_ARRAY;
+        list_for_each_entry(child, &node->child, sibling) {
+            cindex = compact_fill(build, child, json_test_object(node));
+            if (prev)
+                prev->next = cindex;
+            else
+                build->compact->entries[index].con.child = cindex;
+            build->compact->entries[index].con.count++;
+            prev = &build->compact->entries[cindex];
+        }
+        entry = &build->compact->entries[index];
+    } else if (json_test_string(node))
+        compact_text(build, entry, JSON_CTYPE_STRING, node->string);
+    else if (json_test_number(node)) {
+        entry->info = JSON_CTYPE_NUMBER;
+        entry->number = node->number;
+    } else if (json_test_true(node))
+        entry->info = JSON_CTYPE_TRUE;
+    else if (json_test_false(node))
+        entry->info = JSON_CTYPE_FALSE;
+    else
+        entry->info = JSON_CTYPE_NULL;
+
+    if (named)
+        entry->info |= JSON_CENTRY_NAMED;
+
+    return index;
+}
+
+int json_compact_build(struct json_compact *compact, struct json_node *root)
+{
+    struct compact_build build = {compact, 0, 0};
+    size_t entries = 0, pool = 0;
+    int retval;
+
+    if (!root)
+        return -EINVAL;
+
+    retval = compact_measure(root, false, &entries, &pool);
+    if (retval)
+        return retval;
+
+    compact->entries = malloc(entries * sizeof(*compact->entries));
+    if (!compact->entries)
+        return -ENOMEM;
+
+    compact->pool = malloc(pool ? pool : 1);
+    if (!compact->pool) {
+        free(compact->entries);
+        return -ENOMEM;
+    }
+
+    compact->count = entries;
+    compact->pool_size = pool;
+    compact->flags = 0;
+    compact->image = NULL;
+    compact->image_size = 0;
+    compact_fill(&build, root, false);
+
+    return 0;
+}
+
+void json_compact_release(struct json_compact *compact)
+{
+    if (compact->flags & JSON_COMPACT_MAPPED)
+        munmap(compact->image, compact->image_size);
+    else if (!(compact->flags & JSON_COMPACT_BORROWED)) {
+        free(compact->entries);
+        free(compact->pool);
+    }
+
+    compact->flags = 0;
+    compact->image = NULL;
+    compact->image_size = 0;
+    compact->entries = NULL;
+    compact->pool = NULL;
+    compact->count = 0;
+    compact->pool_size = 0;
+}
+
+size_t json_compact_memory(struct json_compact *compact)
+{
+    return compact->count * sizeof(*compact->entries) + compact->pool_size;
+}
+
+int json_compact_expand(const struct json_compact *compact, uint32_t index, struct json_node **root)
+{
+    struct json_node *node, *child;
+    const char *name;
+    uint32_t walk;
+    int retval;
+
+    switch (json_compact_type(compact, index)) {
+        case JSON_CTYPE_ARRAY:
+            node = json_create_array();
+            break;
+
+        case JSON_CTYPE_OBJECT:
+            node = json_create_object();
+            break;
+
+        case JSON_CTYPE_STRING:
+            node = json_create_string(json_compact_text(compact, index));
+            break;
+
+        case JSON_CTYPE_NUMBER:
+            node = json_create_number(json_compact_number(compact, index));
+            break;
+
+        case JSON_CTYPE_TRUE:
+            node = json_create_bool(true);
+            break;
+
+        case JSON_CTYPE_FALSE:
+            node = json_create_bool(false);
+            break;
+
+        case JSON_CTYPE_NULL:
+            node = json_create_null();
+            break;
+
+        default:
+            return -EINVAL;
+    }
+
+    if (!node)
+        return -ENOMEM;
+
+    if (json_test_array(node) || json_test_object(node)) {
+        json_compact_for_each(compact, index, walk) {
+            retval = json_compact_expand(compact, walk, &child);
+            if (retval)
+                goto error;
+            name = json_compact_name(compact, walk);
+            retval = json_append(node, json_test_object(node) ? name : NULL, child);
+            if (retval) {
+                json_release(child);
+                goto error;
+            }
+        }
+    }
+
+    *root = node;
+    return 0;
+
+error:
+    json_release(node);
+    return retval;
+}
+
+size_t json_compact_save(const struct json_compact *compact, void *buff, size_t size)
+{
+    struct json_binary_header header = {
+        .magic = JSON_BINARY_MAGIC,
+        .version = JSON_BINARY_VERSION,
+        .order = JSON_BINARY_ORDER,
+        .count = compact->count,
+        .pool_size = compact->pool_size,
+    };
+    size_t entries, total;
+
+    entries = compact->count * sizeof(*compact->entries);
+    total = sizeof(header) + entries + compact->pool_size;
+    if (!buff || size < total)
+        return total;
+
+    memcpy(buff, &header, sizeof(header));
+    memcpy((char *)buff + sizeof(header), compact->entries, entries);
+    memcpy((char *)buff + sizeof(header) + entries, compact->pool, compact->pool_size);
+
+    return total;
+}
+
+static int compact_text_check(const struct json_compact *compact, const struct json_centry *entry)
+{
+    if (entry->info & JSON_CENTRY_INLINE)
+        return memchr(entry->text, '\0', sizeof(entry->text)) ? 0 : -EINVAL;
+
+    if ((uint64_t)entry->str.offset + entry->str.length >= compact->pool_size)
+        return -EINVAL;
+
+    return compact->pool[entry->str.offset + entry->str.length] ? -EINVAL : 0;
+}
+
+static int compact_walk(const struct json_compact *compact, uint32_t index,
+                        uint32_t *cursor, unsigned int depth)
+{
+    const struct json_centry *entry;
+    uint32_t walk, count = 0;
+    bool object;
+
+    if (index != *cursor || index >= compact->count || depth > COMPACT_DEPTH_MAX)
+        return -EINVAL;
+
+    entry = &compact->entries[(*cursor)++];
+    switch (entry->info & JSON_CENTRY_TYPE) {
+        case JSON_CTYPE_ARRAY: case JSON_CTYPE_OBJECT:
+            break;
+
+        case JSON_CTYPE_STRING:
+            return compact_text_check(compact, entry);
+
+        case JSON_CTYPE_NULL: case JSON_CTYPE_TRUE:
+        case JSON_CTYPE_FALSE: case JSON_CTYPE_NUMBER:
+            return 0;
+
+        default:
+            return -EINVAL;
+    }
+
+    object = json_compact_type(compact, index) == JSON_CTYPE_OBJECT;
+    for (walk = entry->con.child; walk; walk = compact->entries[walk].next) {
+        if (object) {
+            if (*cursor >= compact->count || walk != *cursor + 1 ||
+                json_compact_type(compact, *cursor) != JSON_CTYPE_KEY ||
+                compact_text_check(compact, &compact->entries[*cursor]))
+                return -EINVAL;
+            (*cursor)++;
+        }
+        if (walk >= compact->count ||
+            !!(compact->entries[walk].info & JSON_CENTRY_NAMED) != object)
+            return -EINVAL;
+        if (compact_walk(compact, walk, cursor, depth + 1))
+            return -EINVAL;
+        count++;
+    }
+
+    return count == entry->con.count ? 0 : -EINVAL;
+}
+
+static int compact_check(const struct json_compact *compact)
+{
+    uint32_t cursor = 0;
+
+    if (compact->entries[0].info & JSON_CENTRY_NAMED)
+        return -EINVAL;
+
+    if (compact_walk(compact, 0, &cursor, 0))
+        return -EINVAL;
+
+    return cursor == compact->count ? 0 : -EINVAL;
+}
+
+int json_compact_load(struct json_compact *compact, const void *image, size_t size)
+{
+    const struct json_binary_header *header = image;
+    struct json_compact load;
+    size_t entries;
+    int retval;
+
+    if (size < sizeof(*header) || (uintptr_t)image % __alignof__(struct json_centry))
+        return -EINVAL;
+
+    if (memcmp(header->magic, JSON_BINARY_MAGIC, sizeof(header->magic)))
+        return -EINVAL;
+
+    if (header->version != JSON_BINARY_VERSION || header->order != JSON_BINARY_ORDER)
+        return -EPROTO;
+
+    entries = (size_t)header->count * sizeof(*load.entries);
+    if (!header->count || size != sizeof(*header) + entries + header->pool_size)
+        return -EINVAL;
+
+    /* validate a local copy, the caller's struct is only filled on success */
+    load.entries = (struct json_centry *)(header + 1);
+    load.pool = (char *)load.entries + entries;
+    load.count = header->count;
+    load.pool_size = header->pool_size;
+    load.flags = JSON_COMPACT_BORROWED;
+    load.image = (void *)image;
+    load.image_size = size;
+
+    retval = compact_check(&load);
+    if (retval)
+        return retval;
+
+    *compact = load;
+    return 0;
+}
+
+int json_compact_dump(const struct json_compact *compact, const char *path)
+{
+    size_t size;
+    void *buff;
+    FILE *file;
+    int retval = 0;
+
+    size = json_compact_save(compact, NULL, 0);
+    buff = malloc(size);
+    if (!buff)
+        return -ENOMEM;
+
+    json_compact_save(compact, buff, size);
+
+    file = fopen(path, "wb");
+    if (!file) {
+        retval = -errno;
+        goto finish;
+    }
+
+    if (fwrite(buff, size, 1, file) != 1)
+        retval = -EIO;
+    if (fclose(file) && !retval)
+        retval = -errno;
+
+finish:
+    free(buff);
+    return retval;
+}
+
+int json_compact_open(struct json_compact *compact, const char *path)
+{
+    struct stat stat;
+    void *image;
+    int fd, retval;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -errno;
+
+    if (fstat(fd, &stat)) {
+        retval = -errno;
+        close(fd);
+        return retval;
+    }
+
+    image = mmap(NULL, stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED)
+        return -errno;
+
+    retval = json_compact_load(compact, image, stat.st_size);
+    if (retval) {
+        munmap(image, stat.st_size);
+        return retval;
+    }
+
+    compact->flags = JSON_COMPACT_MAPPED;
+    return 0;
+}
+
+size_t json_memory(struct json_node *root)
+{
+    struct json_node *child;
+    size_t size;
+
+    size = sizeof(*root);
+    if (root->name && !json_test_shared(root))
+        size += strlen(root->name) + 1;
+
+    if (json_test_string(root))
+        size += strlen(root->string) + 1;
+    else if (json_test_array(root) || json_test_object(root)) {
+        list_for_each_entry(child, &root->child, sibling)
+            size += json_memory(child);
+    }
+
+    return size;
+}
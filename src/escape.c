@@ -0,0 +1,275 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2022 Sanpe <sanpeqf@gmail.com>
+ */
+
+#include "json.h"
+#include <string.h>
+
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
+static const char escape_table[0x20] = {
+    [0x08] = 'b', [0x09] = 't', [0x0a] = 'n',
+    [0x0c] = 'f', [0x0d] = 'r',
+};
+
+static const char hex_table[] = "0123456789abcdef";
+
+static inline bool need_escape(unsigned char value)
+{
+    return value < 0x20 || value == '"' || value == '\\';
+}
+
+/* Length of the leading run that can be copied out verbatim. */
+static size_t escape_span(const char *string, size_t length)
+{
+    size_t offset = 0;
+
+#ifdef __SSE2__
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i slash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1f);
+    __m128i block, mask;
+    int bits;
+
+    for (; offset + 16 <= length; offset += 16) {
+        block = _mm_loadu_si128((const __m128i *)(string + offset));
+        mask = _mm_or_si128(_mm_cmpeq_epi8(block, quote), _mm_cmpeq_epi8(block, slash));
+        mask = _mm_or_si128(mask, _mm_cmpeq_epi8(_mm_min_epu8(block, control), block));
+        bits = _mm_movemask_epi8(mask);
+        if (bits)
+            return offset + __builtin_ctz(bits);
+    }
+#endif
+
+    while (offset < length && !need_escape(string[offset]))
+        offset++;
+
+    return offset;
+}
+
+int json_escape(char *buff, int size, const char *string)
+{
+    size_t span, length;
+    unsigned char value;
+    char seq[6];
+    int len = 0, slen;
+
+    length = strlen(string);
+
+    for (;;) {
+        span = escape_span(string, length);
+        if (span) {
+            if (len + 1 < size)
+                memcpy(buff + len, string, min((size_t)(size - len - 1), span));
+            len += span;
+            string += span;
+            length -= span;
+        }
+
+        if (!length)
+            break;
+
+        value = *string++;
+        length--;
+
+        seq[0] = '\\';
+        slen = 2;
+
+        if (value == '"' || value == '\\')
+            seq[1] = value;
+        else if (escape_table[value])
+            seq[1] = escape_table[value];
+        else {
+            seq[1] = 'u';
+            seq[2] = '0';
+            seq[3] = '0';
+            seq[4] = hex_table[value >> 4];
+            seq[5] = hex_table[value & 0xf];
+            slen = 6;
+        }
+
+        if (len + 1 < size)
+            memcpy(buff + len, seq, min(size - len - 1, slen));
+        len += slen;
+    }
+
+    /* truncated like snprintf(), the output is always terminated */
+    if (size > 0)
+        buff[min(len, size - 1)] = '\0';
+
+    return len;
+}
+
+static int hex_value(const char *string)
+{
+    int count, value = 0;
+    char code;
+
+    for (count = 0; count < 4; ++count) {
+        code = string[count];
+        value <<= 4;
+        if ('0' <= code && code <= '9')
+            value |= code - '0';
+        else if ('a' <= code && code <= 'f')
+            value |= code - 'a' + 10;
+        else if ('A' <= code && code <= 'F')
+            value |= code - 'A' + 10;
+        else
+            return -EINVAL;
+    }
+
+    return value;
+}
+
+static int utf8_encode(char *buff, unsigned int code)
+{
+    if (code < 0x80) {
+        buff[0] = code;
+        return 1;
+    } else if (code < 0x800) {
+        buff[0] = 0xc0 | (code >> 6);
+        buff[1] = 0x80 | (code & 0x3f);
+        return 2;
+    } else if (code < 0x10000) {
+        buff[0] = 0xe0 | (code >> 12);
+        buff[1] = 0x80 | ((code >> 6) & 0x3f);
+        buff[2] = 0x80 | (code & 0x3f);
+        return 3;
+    }
+
+    buff[0] = 0xf0 | (code >> 18);
+    buff[1] = 0x80 | ((code >> 12) & 0x3f);
+    buff[2] = 0x80 | ((code >> 6) & 0x3f);
+    buff[3] = 0x80 | (code & 0x3f);
+    return 4;
+}
+
+int json_unescape(char *string, size_t length)
+{
+    char *walk, *end, *out;
+    int code, low;
+
+    walk = memchr(string, '\\', length);
+    if (!walk)
+        return length;
+
+    end = string + length;
+    out = walk;
+
+    while (walk < end) {
+        if (*walk != '\\') {
+            *out++ = *walk++;
+            continue;
+        }
+
+        if (++walk >= end)
+            return -EINVAL;
+
+        switch (*walk++) {
+            case '"':  *out++ = '"';  break;
+            case '\\': *out++ = '\\'; break;
+            case '/':  *out++ = '/';  break;
+            case 'b':  *out++ = '\b'; break;
+            case 'f':  *out++ = '\f'; break;
+            case 'n':  *out++ = '\n'; break;
+            case 'r':  *out++ = '\r'; break;
+            case 't':  *out++ = '\t'; break;
+
+            case 'u':
+                if (end - walk < 4 || (code = hex_value(walk)) < 0)
+                    return -EINVAL;
+                walk += 4;
+
+                if (0xd800 <= code && code <= 0xdbff) {
+                    if (end - walk < 6 || walk[0] != '\\' || walk[1] != 'u')
+                        return -EILSEQ;
+                    low = hex_value(walk + 2);
+                    if (low < 0xdc00 || low > 0xdfff)
+                        return -EILSEQ;
+                    code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                    walk += 6;
+                } else if (0xdc00 <= code && code <= 0xdfff)
+                    return -EILSEQ;
+
+                /* strings are NUL terminated, an embedded NUL can't survive */
+                if (!code)
+                    return -EILSEQ;
+
+                out += utf8_encode(out, code);
+                break;
+
+            default:
+                return -EINVAL;
+        }
+    }
+
+    *out = '\0';
+    return out - string;
+}
+
+static size_t ascii_span(const unsigned char *string, size_t length)
+{
+    size_t offset = 0;
+
+#ifdef __SSE2__
+    __m128i block;
+    int bits;
+
+    for (; offset + 16 <= length; offset += 16) {
+        block = _mm_loadu_si128((const __m128i *)(string + offset));
+        bits = _mm_movemask_epi8(block);
+        if (bits)
+            return offset + __builtin_ctz(bits);
+    }
+#endif
+
+    while (offset < length && string[offset] < 0x80)
+        offset++;
+
+    return offset;
+}
+
+int json_utf8_check(const char *string, size_t length)
+{
+    const unsigned char *walk = (const unsigned char *)string;
+    const unsigned char *end = walk + length;
+    unsigned int code, count, index;
+
+    for (;;) {
+        walk += ascii_span(walk, end - walk);
+        if (walk >= end)
+            return 0;
+
+        code = *walk;
+        if (0xc2 <= code && code <= 0xdf) {
+            count = 1;
+            code &= 0x1f;
+        } else if (0xe0 <= code && code <= 0xef) {
+            count = 2;
+            code &= 0x0f;
+        } else if (0xf0 <= code && code <= 0xf4) {
+            count = 3;
+            code &= 0x07;
+        } else
+            return -EILSEQ;
+
+        if ((size_t)(end - walk) <= count)
+            return -EILSEQ;
+
+        for (index = 1; index <= count; ++index) {
+            if ((walk[index] & 0xc0) != 0x80)
+                return -EILSEQ;
+            code = (code << 6) | (walk[index] & 0x3f);
+        }
+
+        /* overlong forms, surrogates and anything past U+10FFFF */
+        if ((count == 2 && code < 0x800) || (count == 3 && code < 0x10000) ||
+            (0xd800 <= code && code <= 0xdfff) || code > 0x10ffff)
+            return -EILSEQ;
+
+        walk += count + 1;
+    }
+}
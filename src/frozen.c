@@ -0,0 +1,198 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2022 Sanpe <sanpeqf@gmail.com>
+ */
+
+#include "json.h"
+#include "hash.h"
+#include <string.h>
+#include <stdlib.h>
+
+struct frozen_entry {
+    struct frozen_entry *next;
+    struct json_node *node;
+    unsigned long long hash;
+};
+
+struct frozen_index {
+    struct frozen_entry **table;
+    unsigned int capacity;
+    unsigned int count;
+    struct frozen_entry entries[];
+};
+
+struct json_frozen {
+    struct json_node *root;
+    struct frozen_index *index;
+    unsigned long refcount;
+};
+
+static unsigned int frozen_count(struct json_node *parent)
+{
+    struct json_node *child;
+    unsigned int count = 0;
+
+    list_for_each_entry(child, &parent->child, sibling) {
+        if (json_test_object(parent))
+            count++;
+        if (json_test_array(child) || json_test_object(child))
+            count += frozen_count(child);
+    }
+
+    return count;
+}
+
+static void frozen_fill(struct frozen_index *index, struct json_node *parent)
+{
+    struct json_node *child;
+    struct frozen_entry *entry;
+
+    list_for_each_entry(child, &parent->child, sibling) {
+        if (json_test_object(parent)) {
+            entry = &index->entries[index->count++];
+            entry->node = child;
+            entry->hash = hash_member(parent, child->name);
+        }
+        if (json_test_array(child) || json_test_object(child))
+            frozen_fill(index, child);
+    }
+}
+
+static struct frozen_index *frozen_build(struct json_node *root)
+{
+    struct frozen_index *index;
+    struct frozen_entry **slot;
+    unsigned int count, capacity;
+
+    if (json_test_array(root) || json_test_object(root))
+        count = frozen_count(root);
+    else
+        count = 0;
+    for (capacity = 16; capacity < count * 2; capacity *= 2);
+
+    index = malloc(sizeof(*index) + count * sizeof(*index->entries));
+    if (!index)
+        return NULL;
+
+    index->table = calloc(capacity, sizeof(*index->table));
+    if (!index->table) {
+        free(index);
+        return NULL;
+    }
+
+    index->capacity = capacity;
+    index->count = 0;
+    if (count)
+        frozen_fill(index, root);
+
+    /* link back to front so duplicate keys resolve to the first member */
+    while (count--) {
+        slot = &index->table[index->entries[count].hash & (capacity - 1)];
+        index->entries[count].next = *slot;
+        *slot = &index->entries[count];
+    }
+
+    return index;
+}
+
+static void frozen_destroy(struct frozen_index *index)
+{
+    if (!index)
+        return;
+
+    free(index->table);
+    free(index);
+}
+
+static struct frozen_index *frozen_index(struct json_frozen *frozen)
+{
+    struct frozen_index *index, *expect = NULL;
+
+    index = __atomic_load_n(&frozen->index, __ATOMIC_ACQUIRE);
+    if (likely(index))
+        return index;
+
+    index = frozen_build(frozen->root);
+    if (!index)
+        return NULL;
+
+    /* racing builders are harmless, the loser frees its copy */
+    if (!__atomic_compare_exchange_n(&frozen->index, &expect, index, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        frozen_destroy(index);
+        index = expect;
+    }
+
+    return index;
+}
+
+struct json_frozen *json_freeze(struct json_node *root)
+{
+    struct json_frozen *frozen;
+
+    if (!root)
+        return NULL;
+
+    frozen = malloc(sizeof(*frozen));
+    if (!frozen)
+        return NULL;
+
+    frozen->root = root;
+    frozen->index = NULL;
+    frozen->refcount = 1;
+
+    return frozen;
+}
+
+struct json_frozen *json_frozen_get(struct json_frozen *frozen)
+{
+    __atomic_fetch_add(&frozen->refcount, 1, __ATOMIC_RELAXED);
+    return frozen;
+}
+
+void json_frozen_put(struct json_frozen *frozen)
+{
+    if (!frozen)
+        return;
+
+    if (__atomic_sub_fetch(&frozen->refcount, 1, __ATOMIC_ACQ_REL))
+        return;
+
+    frozen_destroy(frozen->index);
+    json_release(frozen->root);
+    free(frozen);
+}
+
+struct json_node *json_frozen_root(struct json_frozen *frozen)
+{
+    return frozen->root;
+}
+
+struct json_node *json_frozen_lookup(struct json_frozen *frozen, struct json_node *object, const char *name)
+{
+    struct frozen_index *index;
+    struct frozen_entry *entry;
+    struct json_node *child;
+    unsigned long long hash;
+
+    if (!json_test_object(object))
+        return NULL;
+
+    index = frozen_index(frozen);
+    if (unlikely(!index)) {
+        list_for_each_entry(child, &object->child, sibling) {
+            if (!strcmp(child->name, name))
+                return child;
+        }
+        return NULL;
+    }
+
+    hash = hash_member(object, name);
+    for (entry = index->table[hash & (index->capacity - 1)]; entry; entry = entry->next) {
+        if (entry->hash == hash && entry->node->parent == object &&
+            !strcmp(entry->node->name, name))
+            return entry->node;
+    }
+
+    return NULL;
+}
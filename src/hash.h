@@ -0,0 +1,34 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2022 Sanpe <sanpeqf@gmail.com>
+ */
+
+#ifndef _HASH_H_
+#define _HASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define HASH_FNV_OFFSET 0xcbf29ce484222325ULL
+#define HASH_FNV_PRIME  0x100000001b3ULL
+
+static inline unsigned long long hash_string(const char *string, size_t length)
+{
+    unsigned long long hash = HASH_FNV_OFFSET;
+
+    while (length--) {
+        hash ^= (unsigned char)*string++;
+        hash *= HASH_FNV_PRIME;
+    }
+
+    return hash;
+}
+
+/* a member is keyed by its name and the object it belongs to */
+static inline unsigned long long hash_member(const void *parent, const char *name)
+{
+    return hash_string(name, strlen(name)) ^ ((uintptr_t)parent >> 4) * HASH_FNV_PRIME;
+}
+
+#endif  /* _HASH_H_ */
@@ -0,0 +1,164 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2022 Sanpe <sanpeqf@gmail.com>
+ */
+
+#include "json.h"
+#include "hash.h"
+#include "stats.h"
+#include <string.h>
+#include <stdlib.h>
+
+#define INTERN_TABLE_DEF    64
+
+struct intern_entry {
+    struct intern_entry *next;
+    unsigned long long hash;
+    size_t length;
+    char name[];
+};
+
+struct json_intern {
+    struct intern_entry **table;
+    unsigned int capacity;
+    unsigned int count;
+    size_t memory;
+};
+
+struct json_intern *json_intern_create(void)
+{
+    struct json_intern *intern;
+
+    intern = malloc(sizeof(*intern));
+    if (!intern)
+        return NULL;
+
+    intern->table = calloc(INTERN_TABLE_DEF, sizeof(*intern->table));
+    if (!intern->table) {
+        free(intern);
+        return NULL;
+    }
+
+    intern->capacity = INTERN_TABLE_DEF;
+    intern->count = 0;
+    intern->memory = sizeof(*intern) + INTERN_TABLE_DEF * sizeof(*intern->table);
+
+    return intern;
+}
+
+void json_intern_destroy(struct json_intern *intern)
+{
+    struct intern_entry *entry, *next;
+    unsigned int count;
+
+    if (!intern)
+        return;
+
+    for (count = 0; count < intern->capacity; ++count) {
+        for (entry = intern->table[count]; entry; entry = next) {
+            next = entry->next;
+            free(entry);
+        }
+    }
+
+    free(intern->table);
+    free(intern);
+}
+
+static struct intern_entry *intern_find(struct json_intern *intern, const char *name,
+                                        size_t length, unsigned long long hash)
+{
+    struct intern_entry *entry;
+
+    entry = intern->table[hash & (intern->capacity - 1)];
+    for (; entry; entry = entry->next) {
+        if (entry->hash == hash && entry->length == length &&
+            !memcmp(entry->name, name, length))
+            return entry;
+    }
+
+    return NULL;
+}
+
+static void intern_grow(struct json_intern *intern)
+{
+    struct intern_entry **table, *entry, *next;
+    unsigned int capacity, count;
+
+    capacity = intern->capacity * 2;
+    table = calloc(capacity, sizeof(*table));
+    if (!table)
+        return;
+    stats_add(alloc_count, 1);
+    stats_add(alloc_bytes, capacity * sizeof(*table));
+
+    for (count = 0; count < intern->capacity; ++count) {
+        for (entry = intern->table[count]; entry; entry = next) {
+            next = entry->next;
+            entry->next = table[entry->hash & (capacity - 1)];
+            table[entry->hash & (capacity - 1)] = entry;
+        }
+    }
+
+    intern->memory += (capacity - intern->capacity) * sizeof(*table);
+    free(intern->table);
+    intern->table = table;
+    intern->capacity = capacity;
+}
+
+const char *json_intern(struct json_intern *intern, const char *name)
+{
+    struct intern_entry *entry, **slot;
+    unsigned long long hash;
+    size_t length;
+
+    length = strlen(name);
+    hash = hash_string(name, length);
+
+    entry = intern_find(intern, name, length, hash);
+    if (entry)
+        return entry->name;
+
+    if (intern->count >= intern->capacity)
+        intern_grow(intern);
+
+    entry = malloc(sizeof(*entry) + length + 1);
+    if (!entry)
+        return NULL;
+    stats_add(alloc_count, 1);
+    stats_add(alloc_bytes, sizeof(*entry) + length + 1);
+
+    entry->hash = hash;
+    entry->length = length;
+    memcpy(entry->name, name, length + 1);
+
+    slot = &intern->table[hash & (intern->capacity - 1)];
+    entry->next = *slot;
+    *slot = entry;
+
+    intern->count++;
+    intern->memory += sizeof(*entry) + length + 1;
+
+    return entry->name;
+}
+
+const char *json_intern_lookup(struct json_intern *intern, const char *name)
+{
+    struct intern_entry *entry;
+    size_t length;
+
+    length = strlen(name);
+    entry = intern_find(intern, name, length, hash_string(name, length));
+
+    return entry ? entry->name : NULL;
+}
+
+unsigned int json_intern_count(struct json_intern *intern)
+{
+    return intern->count;
+}
+
+size_t json_intern_memory(struct json_intern *intern)
+{
+    return intern->memory;
+}
@@ -4,14 +4,26 @@
  */
 
 #include "json.h"
-#include <ctype.h>
+#include "hash.h"
+#include "stats.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #define PASER_TEXT_DEF      64
 #define PASER_NODE_DEPTH    32
 #define PASER_STATE_DEPTH   36
+#define PASER_READ_SIZE     4096
+#define PASER_DUPKEY_DEF    64
+#define PASER_ARENA_DEF     4096
+#define PASER_ROOTS_DEF     8
+#define WRITER_STAGE_DEF    4096
+#define POOL_NODE_MAX       1024
+
+_Static_assert(PASER_NODE_DEPTH <= 64, "open brackets are tracked in 64 bits");
 
 enum json_state {
     JSON_STATE_NULL     = 0,
@@ -46,12 +58,14 @@ static const struct json_transition transition_table[] = {
     {JSON_STATE_BODY,     JSON_STATE_ARRAY,    '[',   '[',    0,    0,  false},
     {JSON_STATE_BODY,     JSON_STATE_OBJECT,   '{',   '{',    0,    0,  false},
     {JSON_STATE_BODY,     JSON_STATE_NUMBER,   '0',   '9',    0,    0,   true},
+    {JSON_STATE_BODY,     JSON_STATE_NUMBER,   '-',   '-',    0,    0,   true},
     {JSON_STATE_BODY,     JSON_STATE_STRING,   '"',   '"',    0,    0,  false},
     {JSON_STATE_BODY,     JSON_STATE_OTHER,   '\0',  '\0',    0,    0,   true},
 
     {JSON_STATE_ARRAY,    JSON_STATE_ARRAY,    '[',   '[',  + 1,  + 1,  false},
     {JSON_STATE_ARRAY,    JSON_STATE_OBJECT,   '{',   '{',  + 1,  + 1,  false},
     {JSON_STATE_ARRAY,    JSON_STATE_NUMBER,   '0',   '9',  + 1,  + 1,   true},
+    {JSON_STATE_ARRAY,    JSON_STATE_NUMBER,   '-',   '-',  + 1,  + 1,   true},
     {JSON_STATE_ARRAY,    JSON_STATE_STRING,   '"',   '"',  + 1,  + 1,  false},
     {JSON_STATE_ARRAY,    JSON_STATE_OTHER,   '\0',  '\0',  + 1,  + 1,   true},
 
@@ -71,6 +85,89 @@ static const struct json_transition transition_table[] = {
     {JSON_STATE_WAIT,     JSON_STATE_WAIT,     '}',   '}',  - 1,  - 1,  false},
 };
 
+#ifdef CONFIG_JSON_STATS
+__thread struct json_stats *json_stats_current;
+
+void json_stats_attach(struct json_stats *stats)
+{
+    json_stats_current = stats;
+}
+#endif
+
+static __thread struct json_node *pool_head;
+static __thread unsigned int pool_count;
+static __thread bool pool_registered;
+
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static pthread_key_t pool_key;
+
+static void pool_exit(void *unused)
+{
+    json_pool_drain();
+}
+
+static void pool_key_init(void)
+{
+    pthread_key_create(&pool_key, pool_exit);
+}
+
+/* a non-NULL key value makes the thread's exit run pool_exit() */
+static void pool_register(void)
+{
+    pthread_once(&pool_once, pool_key_init);
+    pthread_setspecific(pool_key, &pool_registered);
+    pool_registered = true;
+}
+
+static struct json_node *node_alloc(void)
+{
+    struct json_node *node;
+
+    if (pool_head) {
+        node = pool_head;
+        pool_head = node->parent;
+        pool_count--;
+        stats_add(pool_hits, 1);
+    } else {
+        node = malloc(sizeof(*node));
+        if (!node)
+            return NULL;
+        stats_add(alloc_count, 1);
+        stats_add(alloc_bytes, sizeof(*node));
+    }
+
+    memset(node, 0, sizeof(*node));
+    list_head_init(&node->child);
+    return node;
+}
+
+static void node_free(struct json_node *node)
+{
+    if (pool_count >= POOL_NODE_MAX) {
+        free(node);
+        return;
+    }
+
+    if (unlikely(!pool_registered))
+        pool_register();
+
+    node->parent = pool_head;
+    pool_head = node;
+    pool_count++;
+}
+
+void json_pool_drain(void)
+{
+    struct json_node *node;
+
+    while ((node = pool_head)) {
+        pool_head = node->parent;
+        free(node);
+    }
+
+    pool_count = 0;
+}
+
 static inline bool is_struct(enum json_state state)
 {
     return JSON_STATE_ARRAY <= state && state <= JSON_STATE_OBJECT;
@@ -81,34 +178,557 @@ static inline bool is_record(enum json_state state)
     return JSON_STATE_NAME <= state && state <= JSON_STATE_OTHER;
 }
 
-static inline const char *skip_lack(const char *string)
+static inline bool is_quoted(enum json_state state)
 {
-    while (*string && (!isprint(*string) || *string == ' '))
+    return state == JSON_STATE_NAME || state == JSON_STATE_STRING ||
+           state == JSON_STATE_ESC;
+}
+
+static inline bool is_space(char ch)
+{
+    return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+}
+
+static inline const char *skip_lack(const char *string, const char *end)
+{
+    while (string != end && is_space(*string))
         string++;
     return string;
 }
 
-int json_parse(const char *buff, struct json_node **root)
-{
-    enum json_state nstate, cstate = JSON_STATE_ARRAY;
+struct json_parser {
+    const struct json_option *option;
+    enum json_state nstate, cstate;
     enum json_state sstack[PASER_STATE_DEPTH];
     struct json_node *nstack[PASER_NODE_DEPTH];
-    struct json_node *parent, *node = NULL;
-    unsigned int tpos = 0, tsize = PASER_TEXT_DEF;
-    int nspos = 0, cspos = 0, nnpos = -1, cnpos = -1;
-    char *tbuff, *nblock;
-    int retval = 0;
-    const char *walk;
-    bool cross;
+    struct json_node *node;
+    unsigned int tpos, tsize;
+    int nspos, cspos, nnpos, cnpos;
+    char *tbuff;
+    bool cross, done;
+
+    /* open brackets, one bit each set for '{', and a pending ',' */
+    uint64_t brackets;
+    unsigned int bdepth;
+    bool comma;
+
+    /* bytes read from an fd past the end of the last document */
+    char *rbuff;
+    unsigned int rpos, rlen;
+
+    /* members seen so far keyed on (parent, name), and the ones dropped */
+    struct dupkey_entry *dtable;
+    unsigned int dsize, dcount;
+    struct list_head discard;
+
+    /* reuse mode: private node pool and a string arena shared by live trees */
+    bool reuse;
+    struct json_node *pool;
+    struct arena_chunk *arena, *acurr;
+    struct json_node **roots;
+    unsigned int rcount, rsize;
+};
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size, used;
+    char data[];
+};
+
+struct dupkey_entry {
+    struct json_node *node;
+    unsigned long long hash;
+};
+
+static char *arena_strdup(struct json_parser *parser, const char *string, size_t length)
+{
+    struct arena_chunk *chunk, **link;
+    size_t size;
+
+    /* rewound chunks are tried in order, only a miss at the end allocates */
+    for (chunk = parser->acurr; chunk; chunk = chunk->next) {
+        if (chunk->size - chunk->used > length)
+            goto found;
+        parser->acurr = chunk->next ? chunk->next : chunk;
+    }
 
-    tbuff = malloc(tsize);
-    if (!tbuff)
+    size = max((size_t)PASER_ARENA_DEF, length + 1);
+    chunk = malloc(sizeof(*chunk) + size);
+    if (!chunk)
+        return NULL;
+    stats_add(alloc_count, 1);
+    stats_add(alloc_bytes, sizeof(*chunk) + size);
+
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+
+    for (link = &parser->arena; *link; link = &(*link)->next);
+    *link = chunk;
+    parser->acurr = chunk;
+
+found:
+    memcpy(chunk->data + chunk->used, string, length + 1);
+    chunk->used += length + 1;
+
+    return chunk->data + chunk->used - length - 1;
+}
+
+static void arena_rewind(struct json_parser *parser)
+{
+    struct arena_chunk *chunk;
+
+    for (chunk = parser->arena; chunk; chunk = chunk->next)
+        chunk->used = 0;
+
+    parser->acurr = parser->arena;
+}
+
+static struct json_node *parser_node(struct json_parser *parser)
+{
+    struct json_node *node;
+
+    if (!parser->reuse || !parser->pool)
+        return node_alloc();
+
+    node = parser->pool;
+    parser->pool = node->parent;
+    stats_add(pool_hits, 1);
+
+    memset(node, 0, sizeof(*node));
+    list_head_init(&node->child);
+    return node;
+}
+
+static void recycle_node(struct json_parser *parser, struct json_node *root)
+{
+    struct json_node *node, *tmp;
+
+    if (json_test_array(root) || json_test_object(root)) {
+        list_for_each_entry_safe(node, tmp, &root->child, sibling) {
+            list_del(&node->sibling);
+            recycle_node(parser, node);
+        }
+    } else if (json_test_string(root) && !json_test_borrowed(root))
+        free(root->string);
+
+    if (root->name && !json_test_shared(root))
+        free(root->name);
+
+    root->parent = parser->pool;
+    parser->pool = root;
+}
+
+/* give a tree back to the parser it came from, or release it */
+static void parser_release(struct json_parser *parser, struct json_node *root)
+{
+    if (!root)
+        return;
+
+    if (parser->reuse)
+        recycle_node(parser, root);
+    else
+        json_release(root);
+}
+
+static void parser_discard(struct json_parser *parser)
+{
+    struct json_node *node, *tmp;
+
+    list_for_each_entry_safe(node, tmp, &parser->discard, sibling) {
+        list_del(&node->sibling);
+        parser_release(parser, node);
+    }
+
+    if (parser->dcount) {
+        memset(parser->dtable, 0, parser->dsize * sizeof(*parser->dtable));
+        parser->dcount = 0;
+    }
+}
+
+static void parser_reset(struct json_parser *parser)
+{
+    parser->nstate = JSON_STATE_ARRAY;
+    parser->cstate = JSON_STATE_ARRAY;
+    parser->node = NULL;
+    parser->tpos = 0;
+    parser->nspos = parser->cspos = 0;
+    parser->nnpos = parser->cnpos = -1;
+    parser->cross = parser->done = false;
+    parser->brackets = parser->bdepth = 0;
+    parser->comma = false;
+    parser_discard(parser);
+}
+
+static int parser_init(struct json_parser *parser, const struct json_option *option)
+{
+    parser->tsize = PASER_TEXT_DEF;
+    parser->tbuff = malloc(parser->tsize);
+    if (!parser->tbuff)
         return -ENOMEM;
+    stats_add(alloc_count, 1);
+    stats_add(alloc_bytes, parser->tsize);
+
+    parser->option = option;
+    parser->rbuff = NULL;
+    parser->rpos = parser->rlen = 0;
+    parser->dtable = NULL;
+    parser->dsize = parser->dcount = 0;
+    list_head_init(&parser->discard);
+    parser->reuse = false;
+    parser->pool = NULL;
+    parser->arena = parser->acurr = NULL;
+    parser->roots = NULL;
+    parser->rcount = parser->rsize = 0;
+    parser_reset(parser);
+
+    return 0;
+}
+
+static struct json_node *parser_root(struct json_parser *parser)
+{
+    struct json_node *node = parser->node;
+
+    while (node && node->parent)
+        node = node->parent;
+
+    return node;
+}
+
+static void parser_exit(struct json_parser *parser)
+{
+    struct arena_chunk *chunk;
+    struct json_node *node;
+
+    /* a document still being fed goes back before the pool is freed */
+    parser_release(parser, parser_root(parser));
+    parser_discard(parser);
+    while ((node = parser->pool)) {
+        parser->pool = node->parent;
+        free(node);
+    }
+    while ((chunk = parser->arena)) {
+        parser->arena = chunk->next;
+        free(chunk);
+    }
+    free(parser->roots);
+    free(parser->dtable);
+    free(parser->rbuff);
+    free(parser->tbuff);
+}
+
+static int dupkey_grow(struct json_parser *parser)
+{
+    struct dupkey_entry *table, *entry;
+    unsigned int size, count, index;
 
-    for (walk = buff; (is_record(cstate) || (walk = skip_lack(walk))) && *walk; ++walk) {
+    size = parser->dsize ? parser->dsize * 2 : PASER_DUPKEY_DEF;
+    table = calloc(size, sizeof(*table));
+    if (!table)
+        return -ENOMEM;
+    stats_add(alloc_count, 1);
+    stats_add(alloc_bytes, size * sizeof(*table));
+
+    for (count = 0; count < parser->dsize; ++count) {
+        entry = &parser->dtable[count];
+        if (!entry->node)
+            continue;
+        for (index = entry->hash & (size - 1); table[index].node; index = (index + 1) & (size - 1));
+        table[index] = *entry;
+    }
+
+    free(parser->dtable);
+    parser->dtable = table;
+    parser->dsize = size;
+
+    return 0;
+}
+
+/* called once a member's name is known, before its value is parsed */
+static int parser_dupkey(struct json_parser *parser, struct json_node *node)
+{
+    struct json_node *parent = node->parent, *old;
+    struct dupkey_entry *entry;
+    unsigned long long hash;
+    unsigned int index;
+
+    if (parser->dcount * 2 >= parser->dsize && dupkey_grow(parser))
+        return -ENOMEM;
+
+    hash = hash_member(parent, node->name);
+
+    for (index = hash & (parser->dsize - 1);; index = (index + 1) & (parser->dsize - 1)) {
+        entry = &parser->dtable[index];
+        if (!entry->node) {
+            entry->node = node;
+            entry->hash = hash;
+            parser->dcount++;
+            return 0;
+        }
+        old = entry->node;
+        if (entry->hash == hash && old->parent == parent &&
+            (old->name == node->name || !strcmp(old->name, node->name)))
+            break;
+    }
+
+    /*
+     * Dropped members are parked rather than freed, so no address in the
+     * table can be reused by a later node while the parse is running.
+     */
+    switch (parser->option->dupkey) {
+        case JSON_DUPKEY_FIRST:
+            list_del(&node->sibling);
+            list_add_prev(&parser->discard, &node->sibling);
+            return 0;
+
+        case JSON_DUPKEY_LAST:
+            list_del(&old->sibling);
+            list_add_prev(&parser->discard, &old->sibling);
+            entry->node = node;
+            return 0;
+
+        default:
+            return -EEXIST;
+    }
+}
+
+static void parser_abort(struct json_parser *parser)
+{
+    parser_release(parser, parser_root(parser));
+    parser_reset(parser);
+}
+
+struct json_parser *json_parser_create(const struct json_option *option)
+{
+    struct json_parser *parser;
+
+    parser = malloc(sizeof(*parser));
+    if (!parser)
+        return NULL;
+
+    if (parser_init(parser, option)) {
+        free(parser);
+        return NULL;
+    }
+
+    return parser;
+}
+
+struct json_parser *json_parser_create_reuse(const struct json_option *option)
+{
+    struct json_parser *parser;
+
+    parser = json_parser_create(option);
+    if (parser)
+        parser->reuse = true;
+
+    return parser;
+}
+
+/* remember a tree handed out in reuse mode, it borrows from the arena */
+static int parser_own(struct json_parser *parser, struct json_node *root)
+{
+    struct json_node **roots;
+    unsigned int size;
+
+    if (parser->rcount == parser->rsize) {
+        size = parser->rsize ? parser->rsize * 2 : PASER_ROOTS_DEF;
+        roots = realloc(parser->roots, size * sizeof(*roots));
+        if (!roots)
+            return -ENOMEM;
+        stats_add(alloc_count, 1);
+        stats_add(alloc_bytes, size * sizeof(*roots));
+        parser->roots = roots;
+        parser->rsize = size;
+    }
+
+    parser->roots[parser->rcount++] = root;
+    return 0;
+}
+
+int json_parser_recycle(struct json_parser *parser, struct json_node *root)
+{
+    unsigned int index;
+
+    if (!root)
+        return 0;
+
+    if (root->parent)
+        return -EINVAL;
+
+    /* only whole trees this parser handed out, the newest is the usual one */
+    if (parser->reuse) {
+        for (index = parser->rcount; index; --index) {
+            if (parser->roots[index - 1] == root)
+                break;
+        }
+        if (!index)
+            return -EINVAL;
+        parser->roots[index - 1] = parser->roots[--parser->rcount];
+    }
+
+    parser_release(parser, root);
+    return 0;
+}
+
+void json_parser_destroy(struct json_parser *parser)
+{
+    if (!parser)
+        return;
+
+    parser_exit(parser);
+    free(parser);
+}
+
+/* nodes only hold a long, so numbers are integers: -?(0|[1-9][0-9]*) */
+static int parse_number(const char *text, long *value)
+{
+    const char *walk = text;
+    char *end;
+
+    if (*walk == '-')
+        walk++;
+    if (*walk < '0' || *walk > '9' || (*walk == '0' && walk[1]))
+        return -EINVAL;
+
+    errno = 0;
+    *value = strtol(text, &end, 10);
+    if (*end)
+        return -EINVAL;
+
+    return errno == ERANGE ? -ERANGE : 0;
+}
+
+static int parse_record(struct json_parser *parser, enum json_state state,
+                        struct json_node *node, char *tbuff, unsigned int tpos)
+{
+    const struct json_option *option = parser->option;
+    int retval;
+
+    /* bare tokens run up to the next delimiter, drop the blanks before it */
+    if (state == JSON_STATE_NUMBER || state == JSON_STATE_OTHER) {
+        while (tpos && is_space(tbuff[tpos - 1]))
+            tpos--;
+    }
+
+    tbuff[tpos] = '\0';
+    if (state == JSON_STATE_NAME || state == JSON_STATE_STRING) {
+        stats_start(decode);
+        retval = json_unescape(tbuff, tpos);
+        if (retval < 0)
+            return retval;
+        tpos = retval;
+        retval = json_utf8_check(tbuff, tpos);
+        if (retval)
+            return retval;
+        stats_stop(decode_ns, decode);
+        /* an interned name counts in json_intern(), once per new key */
+        if (!(state == JSON_STATE_NAME && option && option->intern) && !parser->reuse) {
+            stats_add(alloc_count, 1);
+            stats_add(alloc_bytes, tpos + 1);
+        }
+    }
+
+    switch (state) {
+        case JSON_STATE_NAME:
+            if (option && option->intern) {
+                node->name = (char *)json_intern(option->intern, tbuff);
+                json_set_shared(node);
+            } else if (parser->reuse) {
+                node->name = arena_strdup(parser, tbuff, tpos);
+                json_set_shared(node);
+            } else
+                node->name = strdup(tbuff);
+            if (!node->name)
+                return -ENOMEM;
+            return 0;
+
+        case JSON_STATE_STRING:
+            if (parser->reuse) {
+                node->string = arena_strdup(parser, tbuff, tpos);
+                json_set_borrowed(node);
+            } else
+                node->string = strdup(tbuff);
+            if (!node->string)
+                return -ENOMEM;
+            json_set_string(node);
+            break;
+
+        case JSON_STATE_NUMBER:
+            retval = parse_number(tbuff, &node->number);
+            if (retval)
+                return retval;
+            json_set_number(node);
+            break;
+
+        case JSON_STATE_OTHER:
+            if (!strcmp(tbuff, "null"))
+                json_set_null(node);
+            else if (!strcmp(tbuff, "true"))
+                json_set_true(node);
+            else if (!strcmp(tbuff, "false"))
+                json_set_false(node);
+            else
+                return -EINVAL;
+            break;
+
+        default:
+            return 0;
+    }
+
+    stats_node(node);
+    return 0;
+}
+
+/* a NULL end runs up to the NUL terminator instead */
+static ssize_t parser_feed(struct json_parser *parser, const char *buff, const char *end)
+{
+    enum json_state nstate = parser->nstate, cstate = parser->cstate;
+    enum json_state *sstack = parser->sstack;
+    struct json_node **nstack = parser->nstack;
+    struct json_node *parent, *node = parser->node;
+    unsigned int tpos = parser->tpos, tsize = parser->tsize;
+    int nspos = parser->nspos, cspos = parser->cspos;
+    int nnpos = parser->nnpos, cnpos = parser->cnpos;
+    const char *walk;
+    char *tbuff = parser->tbuff, *nblock;
+    bool cross = parser->cross, done = parser->done;
+    uint64_t brackets = parser->brackets;
+    unsigned int bdepth = parser->bdepth;
+    bool comma = parser->comma;
+    int retval = 0;
+    stats_start(start);
+
+    if (done)
+        return 0;
+
+    /* nothing borrows from the arena between documents once all came back */
+    if (parser->reuse && !node && !parser->rcount)
+        arena_rewind(parser);
+
+    for (walk = buff; walk != end; ++walk) {
         const struct json_transition *major, *minor = NULL;
         unsigned int count;
 
+        if (!is_quoted(cstate) && !is_record(cstate)) {
+            walk = skip_lack(walk, end);
+            if (walk == end)
+                break;
+        }
+
+        if (unlikely(!*walk)) {
+            if (!end)
+                break;
+            retval = -EINVAL;
+            goto error;
+        }
+
+        /* raw control bytes must be escaped inside strings */
+        if (is_quoted(cstate) && unlikely((unsigned char)*walk < 0x20)) {
+            retval = -EINVAL;
+            goto error;
+        }
+
         for (count = 0; count < ARRAY_SIZE(transition_table); ++count) {
             major = &transition_table[count];
             if (major->form == cstate) {
@@ -130,11 +750,34 @@ int json_parse(const char *buff, struct json_node **root)
             nspos += major->sstack;
             nstate = major->to;
             cross = major->cross;
+        } else if (!is_record(cstate)) {
+            retval = -EINVAL;
+            goto error;
         }
 
+        /* closers must pair with their opener and never follow a ',' */
+        if (major && major->code == *walk) {
+            if (*walk == '[' || *walk == '{') {
+                brackets = brackets << 1 | (*walk == '{');
+                bdepth++;
+            } else if (*walk == ']' || *walk == '}') {
+                if (comma || !bdepth || (brackets & 1) != (*walk == '}')) {
+                    retval = -EINVAL;
+                    goto error;
+                }
+                brackets >>= 1;
+                bdepth--;
+            }
+        }
+        if (major)
+            comma = *walk == ',' && major->code == ',';
+
         if (nnpos >= PASER_NODE_DEPTH || nspos >= PASER_STATE_DEPTH) {
             retval = -EOVERFLOW;
             goto error;
+        } else if (nnpos < -1 || nspos < 0 || (nnpos < 0 && cnpos < 0)) {
+            retval = -EINVAL;
+            goto error;
         }
 
         if (nspos > cspos && cstate != JSON_STATE_NULL)
@@ -142,22 +785,27 @@ int json_parse(const char *buff, struct json_node **root)
         else if (nspos < cspos && nstate == JSON_STATE_NULL)
             nstate = sstack[nspos];
 
-        if (nnpos < cnpos && nnpos < 0)
-            break;
-        else if (nnpos > cnpos) {
+        if (nnpos < 0 && cnpos >= 0) {
+            /* only a bare top-level scalar gets here on a ',' */
+            if (comma) {
+                retval = -EINVAL;
+                goto error;
+            }
+            done = true;
+        } else if (nnpos > cnpos) {
             parent = node;
-            node = malloc(sizeof(*node));
+            node = parser_node(parser);
             if (!node) {
+                node = parent;
                 retval = -ENOMEM;
                 goto error;
             }
-            memset(node, 0, sizeof(*node));
             if (cnpos >= 0) {
                 nstack[cnpos] = parent;
                 list_add_prev(&nstack[cnpos]->child, &node->sibling);
             }
             node->parent = parent;
-            list_head_init(&node->child);
+            stats_max(max_depth, nnpos + 1);
         }
 
         if (is_struct(nstate)) {
@@ -173,64 +821,43 @@ int json_parse(const char *buff, struct json_node **root)
                 default:
                     break;
             }
+            if (*walk == '[' || *walk == '{')
+                stats_node(node);
         }
 
-        if (nstate != JSON_STATE_ESC) {
-            if (is_record(cstate) && !is_record(nstate)) {
-                tbuff[tpos] = '\0';
-                switch (cstate) {
-                    case JSON_STATE_NAME:
-                        node->name = strdup(tbuff);
-                        if (!node->name) {
-                            retval = -ENOMEM;
-                            goto error;
-                        }
-                        break;
-
-                    case JSON_STATE_STRING:
-                        node->string = strdup(tbuff);
-                        if (!node->string) {
-                            retval = -ENOMEM;
-                            goto error;
-                        }
-                        json_set_string(node);
-                        break;
-
-                    case JSON_STATE_NUMBER:
-                        node->number = atol(tbuff);
-                        json_set_number(node);
-                        break;
-
-                    case JSON_STATE_OTHER:
-                        if (!strcmp(tbuff, "null"))
-                            json_set_null(node);
-                        else if (!strcmp(tbuff, "true"))
-                            json_set_true(node);
-                        else if (!strcmp(tbuff, "false"))
-                            json_set_false(node);
-                        break;
-
-                    default:
-                        break;
+        if (nstate != JSON_STATE_ESC && is_record(cstate) && !is_record(nstate)) {
+            retval = parse_record(parser, cstate, node, tbuff, tpos);
+            if (!retval && cstate == JSON_STATE_NAME && parser->option &&
+                parser->option->dupkey != JSON_DUPKEY_APPEND)
+                retval = parser_dupkey(parser, node);
+            if (retval)
+                goto error;
+            tpos = 0;
+        } else if (cross || is_record(cstate)) {
+            if (unlikely(tpos + 1 >= tsize)) {
+                if (tsize > UINT_MAX / 2) {
+                    retval = -EOVERFLOW;
+                    goto error;
                 }
-                tpos = 0;
-            } else if (cross || is_record(cstate)) {
-                if (unlikely(tpos >= tsize)) {
-                    tsize *= 2;
-                    nblock = realloc(tbuff, tsize);
-                    if (!nblock) {
-                        free(tbuff);
-                        retval = -ENOMEM;
-                        goto error;
-                    }
-                    tbuff = nblock;
+                nblock = realloc(tbuff, tsize * 2);
+                if (!nblock) {
+                    retval = -ENOMEM;
+                    goto error;
                 }
-                tbuff[tpos++] = *walk;
-                cross = false;
+                tbuff = nblock;
+                tsize *= 2;
+                stats_add(tbuff_reallocs, 1);
+                stats_add(alloc_count, 1);
+                stats_add(alloc_bytes, tsize);
             }
+            tbuff[tpos++] = *walk;
+            cross = false;
         }
 
-        if (nnpos < cnpos)
+        if (done) {
+            walk++;
+            break;
+        } else if (nnpos < cnpos)
             node = nstack[nnpos];
 
         cnpos = nnpos;
@@ -238,95 +865,716 @@ int json_parse(const char *buff, struct json_node **root)
         cstate = nstate;
     }
 
+    parser->nstate = nstate;
+    parser->cstate = cstate;
+    parser->node = node;
+    parser->tpos = tpos;
+    parser->nspos = nspos;
+    parser->cspos = cspos;
+    parser->nnpos = nnpos;
+    parser->cnpos = cnpos;
+    parser->cross = cross;
+    parser->done = done;
+    parser->brackets = brackets;
+    parser->bdepth = bdepth;
+    parser->comma = comma;
+    parser->tbuff = tbuff;
+    parser->tsize = tsize;
+
+    stats_add(parse_bytes, walk - buff);
+    stats_stop(parse_ns, start);
+
+    return walk - buff;
+
 error:
-    free(tbuff);
-    if (cnpos > 0)
-        node = *nstack;
+    parser->node = node;
+    parser->tbuff = tbuff;
+    parser->tsize = tsize;
+    parser_abort(parser);
 
-    if (retval)
-        json_release(node);
-    else if (root)
+    return retval;
+}
+
+ssize_t json_parser_feed(struct json_parser *parser, const char *buff, size_t length)
+{
+    return parser_feed(parser, buff, buff + length);
+}
+
+int json_parser_finish(struct json_parser *parser, struct json_node **root)
+{
+    struct json_node *node;
+    int retval = 0;
+
+    /* a bare number or literal at the top level ends with the input */
+    if (!parser->done && parser->cnpos == 0 &&
+        (parser->cstate == JSON_STATE_NUMBER || parser->cstate == JSON_STATE_OTHER)) {
+        retval = parse_record(parser, parser->cstate, parser->node,
+                              parser->tbuff, parser->tpos);
+        parser->done = !retval;
+    }
+
+    /* still open, keep it for the next feed */
+    if (!parser->done && !retval && parser->node)
+        return -EAGAIN;
+
+    node = parser_root(parser);
+    if (!node)
+        retval = -ENODATA;
+    else if (!retval && root && parser->reuse)
+        retval = parser_own(parser, node);
+
+    if (node && (retval || !root))
+        parser_release(parser, node);
+    else if (node)
         *root = node;
 
-    return node ? retval : -ENODATA;
+    parser_reset(parser);
+    return retval;
 }
 
-static int encode_depth(struct json_node *parent, char *buff, int size, int len, unsigned int depth)
+bool json_parser_done(struct json_parser *parser)
 {
-    #define json_sprintf(fmt, ...) len += snprintf(buff + len, max(0, size - len), fmt, ##__VA_ARGS__)
-    struct json_node *child;
-    unsigned int count;
+    return parser->done;
+}
 
-    if (json_test_array(parent))
-        json_sprintf("[\n");
-    else if (json_test_object(parent))
-        json_sprintf("{\n");
-    else
-        return 0;
+/* the input has ended, a document still open there is truncated */
+static int parser_close(struct json_parser *parser, struct json_node **root)
+{
+    int retval;
+
+    retval = json_parser_finish(parser, root);
+    if (retval == -EAGAIN) {
+        parser_abort(parser);
+        retval = -EINVAL;
+    }
+
+    return retval;
+}
+
+int json_parser_read(struct json_parser *parser, int fd, struct json_node **root)
+{
+    ssize_t length, retval;
+
+    if (!parser->rbuff) {
+        parser->rbuff = malloc(PASER_READ_SIZE);
+        if (!parser->rbuff)
+            return -ENOMEM;
+        stats_add(alloc_count, 1);
+        stats_add(alloc_bytes, PASER_READ_SIZE);
+    }
+
+    for (;;) {
+        if (parser->rpos == parser->rlen) {
+            length = read(fd, parser->rbuff, PASER_READ_SIZE);
+            if (length < 0) {
+                if (errno == EINTR)
+                    continue;
+                return errno == EWOULDBLOCK ? -EAGAIN : -errno;
+            } else if (!length)
+                return parser_close(parser, root);
+            parser->rpos = 0;
+            parser->rlen = length;
+        }
+
+        retval = json_parser_feed(parser, parser->rbuff + parser->rpos,
+                                  parser->rlen - parser->rpos);
+        if (retval < 0) {
+            parser->rpos = parser->rlen = 0;
+            return retval;
+        }
+
+        /* anything after the document stays queued for the next call */
+        parser->rpos += retval;
+        if (parser->done)
+            return json_parser_finish(parser, root);
+    }
+}
+
+static int parser_oneshot(struct json_parser *parser, const char *buff, struct json_node **root)
+{
+    ssize_t retval;
+
+    retval = parser_feed(parser, buff, NULL);
+    if (retval < 0)
+        return retval;
+
+    /* the buffer holds a single document, only blanks may follow it */
+    if (*skip_lack(buff + retval, NULL)) {
+        parser_abort(parser);
+        return -EINVAL;
+    }
+
+    return parser_close(parser, root);
+}
 
+int json_parser_parse(struct json_parser *parser, const char *buff, struct json_node **root)
+{
+    return parser_oneshot(parser, buff, root);
+}
+
+int json_parse_option(const char *buff, struct json_node **root, const struct json_option *option)
+{
+    struct json_parser parser;
+    int retval;
+
+    retval = parser_init(&parser, option);
+    if (retval)
+        return retval;
+
+    retval = parser_oneshot(&parser, buff, root);
+    parser_exit(&parser);
+
+    return retval;
+}
+
+int json_parse(const char *buff, struct json_node **root)
+{
+    return json_parse_option(buff, root, NULL);
+}
+
+#define json_sprintf(fmt, ...) len += snprintf(buff + len, max(0, size - len), fmt, ##__VA_ARGS__)
+#define json_sescape(string) len += json_escape(buff + len, max(0, size - len), string)
+
+struct encode_member {
+    struct json_node *node;
+    unsigned int index;
+};
+
+struct encode_ctx {
+    unsigned int flags;
+    struct encode_member *members;
+    unsigned int msize, mpos;
+    int retval;
+};
+
+static int member_cmp(const void *a, const void *b)
+{
+    const struct encode_member *ma = a, *mb = b;
+    int retval;
+
+    retval = strcmp(ma->node->name ? ma->node->name : "", mb->node->name ? mb->node->name : "");
+    if (retval)
+        return retval;
+
+    /* duplicate names keep their document order */
+    return (ma->index > mb->index) - (ma->index < mb->index);
+}
+
+/* sort an object's members into a slice of the scratch array, nested slices stack up */
+static int encode_sort(struct encode_ctx *ctx, struct json_node *parent, unsigned int *count)
+{
+    struct encode_member *nblock;
+    struct json_node *child;
+    unsigned int base = ctx->mpos, size;
+
+    *count = 0;
     list_for_each_entry(child, &parent->child, sibling) {
+        if (base + *count == ctx->msize) {
+            size = ctx->msize ? ctx->msize * 2 : 64;
+            nblock = realloc(ctx->members, size * sizeof(*nblock));
+            if (!nblock) {
+                ctx->retval = -ENOMEM;
+                return -ENOMEM;
+            }
+            ctx->members = nblock;
+            ctx->msize = size;
+        }
+        ctx->members[base + *count].node = child;
+        ctx->members[base + *count].index = *count;
+        (*count)++;
+    }
+
+    if (*count > 1)
+        qsort(ctx->members + base, *count, sizeof(*ctx->members), member_cmp);
+    ctx->mpos = base + *count;
+
+    return base;
+}
+
+static int encode_depth(struct encode_ctx *ctx, struct json_node *parent, char *buff,
+                        int size, int len, unsigned int depth);
+
+static int encode_child(struct encode_ctx *ctx, struct json_node *parent, struct json_node *child,
+                        char *buff, int size, int len, unsigned int depth)
+{
+    bool compact = ctx && (ctx->flags & JSON_ENCODE_COMPACT);
+    unsigned int count;
+
+    if (!compact) {
         for (count = 0; count < depth + 1; ++count)
             json_sprintf("\t");
-        if (json_test_object(parent))
-            json_sprintf("%s: ", child->name);
-        if (json_test_array(child) || json_test_object(child))
-            len = encode_depth(child, buff, size, len, depth + 1);
-        else if (json_test_number(child))
-            json_sprintf("%ld,\n", child->number);
-        else if (json_test_string(child))
-            json_sprintf("\"%s\",\n", child->string);
-        else if (json_test_null(child))
-            json_sprintf("null,\n");
-        else if (json_test_true(child))
-            json_sprintf("true,\n");
-        else /* json_test_false(child) */
-            json_sprintf("false,\n");
     }
 
-    if (!list_check_empty(&parent->child)) {
-        len -= 2;
-        json_sprintf("\n");
+    if (json_test_object(parent)) {
+        json_sprintf("\"");
+        json_sescape(child->name ? child->name : "");
+        json_sprintf(compact ? "\":" : "\": ");
+    }
+
+    len = encode_depth(ctx, child, buff, size, len, depth + 1);
+    json_sprintf(compact ? "," : ",\n");
+
+    return len;
+}
+
+static int encode_depth(struct encode_ctx *ctx, struct json_node *parent, char *buff,
+                        int size, int len, unsigned int depth)
+{
+    bool compact = ctx && (ctx->flags & JSON_ENCODE_COMPACT);
+    struct json_node *child;
+    unsigned int count, index;
+    int base;
+
+    if (json_test_number(parent)) {
+        json_sprintf("%ld", parent->number);
+        return len;
+    } else if (json_test_string(parent)) {
+        json_sprintf("\"");
+        json_sescape(parent->string);
+        json_sprintf("\"");
+        return len;
+    } else if (json_test_null(parent)) {
+        json_sprintf("null");
+        return len;
+    } else if (json_test_true(parent)) {
+        json_sprintf("true");
+        return len;
+    } else if (!json_test_array(parent) && !json_test_object(parent)) {
+        json_sprintf("false");
+        return len;
     }
 
-    for (count = 0; count < depth; ++count)
-        json_sprintf("\t");
-    if (json_test_array(parent))
-        json_sprintf("],\n");
-    else if (json_test_object(parent))
-        json_sprintf("},\n");
+    if (compact)
+        json_sprintf(json_test_array(parent) ? "[" : "{");
+    else
+        json_sprintf(json_test_array(parent) ? "[\n" : "{\n");
+
+    if (ctx && (ctx->flags & JSON_ENCODE_SORTED) && json_test_object(parent) &&
+        (base = encode_sort(ctx, parent, &count)) >= 0) {
+        /* nested objects may grow the scratch array, index it afresh */
+        for (index = 0; index < count; ++index)
+            len = encode_child(ctx, parent, ctx->members[base + index].node,
+                               buff, size, len, depth);
+        ctx->mpos = base;
+    } else {
+        list_for_each_entry(child, &parent->child, sibling)
+            len = encode_child(ctx, parent, child, buff, size, len, depth);
+    }
 
-    if (!parent->parent) {
-        len -= 2;
-        json_sprintf("\n");
+    if (!list_check_empty(&parent->child)) {
+        len -= compact ? 1 : 2;
+        if (!compact)
+            json_sprintf("\n");
     }
 
+    if (!compact) {
+        for (count = 0; count < depth; ++count)
+            json_sprintf("\t");
+    }
+    json_sprintf(json_test_array(parent) ? "]" : "}");
+
     return len;
 }
 
+int json_encode_option(struct json_node *root, char *buff, int size, const struct json_option *option)
+{
+    struct encode_ctx ctx = {
+        .flags = option ? option->encode : 0,
+    };
+    int length;
+    stats_start(start);
+
+    length = encode_depth(&ctx, root, buff, size, 0, 0);
+    length += snprintf(buff + length, max(0, size - length), "%s",
+                       ctx.flags & JSON_ENCODE_COMPACT ? "" : "\n") + 1;
+    free(ctx.members);
+
+    /* a size probe writes nothing, count only what landed in buff */
+    if (buff && size > 0 && !ctx.retval) {
+        stats_add(encode_bytes, min(length, size));
+        stats_stop(encode_ns, start);
+    }
+
+    return ctx.retval ? ctx.retval : length;
+}
+
 int json_encode(struct json_node *root, char *buff, int size)
 {
-    return encode_depth(root, buff, size, 0, 0) + 1;
+    return json_encode_option(root, buff, size, NULL);
 }
 
-void json_release(struct json_node *root)
+struct json_writer {
+    struct json_node *root, *node;
+    unsigned int depth;
+    bool enter, finished;
+    char *stage;
+    int ssize, slen, spos;
+};
+
+struct json_writer *json_writer_create(struct json_node *root)
+{
+    struct json_writer *writer;
+
+    writer = malloc(sizeof(*writer));
+    if (!writer)
+        return NULL;
+
+    writer->stage = malloc(WRITER_STAGE_DEF);
+    if (!writer->stage) {
+        free(writer);
+        return NULL;
+    }
+
+    writer->root = writer->node = root;
+    writer->depth = 0;
+    writer->enter = true;
+    writer->finished = false;
+    writer->ssize = WRITER_STAGE_DEF;
+    writer->slen = writer->spos = 0;
+
+    return writer;
+}
+
+void json_writer_destroy(struct json_writer *writer)
+{
+    if (!writer)
+        return;
+
+    free(writer->stage);
+    free(writer);
+}
+
+static int stage_reserve(struct json_writer *writer, int length)
+{
+    char *nblock;
+    int size;
+
+    if (writer->slen + length < writer->ssize)
+        return 0;
+
+    size = max(writer->ssize * 2, writer->slen + length + 1);
+    nblock = realloc(writer->stage, size);
+    if (!nblock)
+        return -ENOMEM;
+
+    writer->stage = nblock;
+    writer->ssize = size;
+
+    return 0;
+}
+
+/* scalars and names go through the json_encode() helpers, retried once grown */
+static int stage_node(struct json_writer *writer, struct json_node *node, const char *name)
+{
+    int length, room;
+
+    do {
+        room = writer->ssize - writer->slen;
+        if (name)
+            length = json_escape(writer->stage + writer->slen, room, name);
+        else
+            length = encode_depth(NULL, node, writer->stage + writer->slen, room, 0, 0);
+        if (length < room)
+            break;
+        if (stage_reserve(writer, length))
+            return -ENOMEM;
+    } while (true);
+
+    writer->slen += length;
+    return 0;
+}
+
+static int stage_text(struct json_writer *writer, const char *text, unsigned int tabs)
+{
+    int length = strlen(text);
+
+    if (stage_reserve(writer, tabs + length))
+        return -ENOMEM;
+
+    memset(writer->stage + writer->slen, '\t', tabs);
+    memcpy(writer->stage + writer->slen + tabs, text, length);
+    writer->slen += tabs + length;
+
+    return 0;
+}
+
+static int writer_step(struct json_writer *writer)
+{
+    struct json_node *node = writer->node;
+    int retval = 0;
+
+    if (writer->enter) {
+        if (node != writer->root) {
+            if (json_test_object(node->parent)) {
+                retval |= stage_text(writer, "\"", writer->depth);
+                retval |= stage_node(writer, NULL, node->name ? node->name : "");
+                retval |= stage_text(writer, "\": ", 0);
+            } else
+                retval |= stage_text(writer, "", writer->depth);
+        }
+
+        if (!json_test_array(node) && !json_test_object(node)) {
+            retval |= stage_node(writer, node, NULL);
+            writer->enter = false;
+        } else if (list_check_empty(&node->child)) {
+            retval |= stage_text(writer, json_test_array(node) ? "[\n" : "{\n", 0);
+            retval |= stage_text(writer, json_test_array(node) ? "]" : "}", writer->depth);
+            writer->enter = false;
+        } else {
+            retval |= stage_text(writer, json_test_array(node) ? "[\n" : "{\n", 0);
+            writer->node = list_first_entry(&node->child, struct json_node, sibling);
+            writer->depth++;
+        }
+
+        return retval;
+    }
+
+    if (node == writer->root) {
+        writer->finished = true;
+        return stage_text(writer, "\n", 0);
+    }
+
+    if (node->sibling.next != &node->parent->child) {
+        writer->node = list_next_entry(node, sibling);
+        writer->enter = true;
+        return stage_text(writer, ",\n", 0);
+    }
+
+    writer->node = node->parent;
+    writer->depth--;
+    retval |= stage_text(writer, "\n", 0);
+    retval |= stage_text(writer, json_test_array(node->parent) ? "]" : "}", writer->depth);
+
+    return retval;
+}
+
+int json_writer_fill(struct json_writer *writer, char *buff, int size)
+{
+    int length, copied = 0;
+
+    while (copied < size) {
+        if (writer->spos == writer->slen) {
+            if (writer->finished)
+                break;
+            writer->spos = writer->slen = 0;
+            if (writer_step(writer))
+                return -ENOMEM;
+            continue;
+        }
+
+        length = min(size - copied, writer->slen - writer->spos);
+        memcpy(buff + copied, writer->stage + writer->spos, length);
+        writer->spos += length;
+        copied += length;
+    }
+
+    stats_add(encode_bytes, copied);
+    return copied;
+}
+
+int json_writer_write(struct json_writer *writer, int fd)
+{
+    ssize_t length;
+
+    for (;;) {
+        /* batch small pieces so a write() carries a useful amount */
+        while (!writer->finished && writer->slen < WRITER_STAGE_DEF) {
+            if (writer->spos == writer->slen)
+                writer->spos = writer->slen = 0;
+            if (writer_step(writer))
+                return -ENOMEM;
+        }
+
+        if (writer->spos == writer->slen)
+            return 0;
+
+        length = write(fd, writer->stage + writer->spos, writer->slen - writer->spos);
+        if (length < 0) {
+            if (errno == EINTR)
+                continue;
+            return errno == EWOULDBLOCK ? -EAGAIN : -errno;
+        }
+
+        stats_add(encode_bytes, length);
+        writer->spos += length;
+        if (writer->spos == writer->slen)
+            writer->spos = writer->slen = 0;
+    }
+}
+
+static void release_node(struct json_node *root)
 {
     struct json_node *node, *tmp;
 
     if (unlikely(!root))
         return;
 
-    list_for_each_entry_safe(node, tmp, &root->child, sibling) {
-        list_del(&node->sibling);
-        if (json_test_array(node) || json_test_object(node)) {
-            json_release(node);
-            continue;
+    if (json_test_array(root) || json_test_object(root)) {
+        list_for_each_entry_safe(node, tmp, &root->child, sibling) {
+            list_del(&node->sibling);
+            release_node(node);
         }
-        if (node->name)
-            free(node->name);
-        if (json_test_string(node))
-            free(node->string);
-        free(node);
+    } else if (json_test_string(root) && !json_test_borrowed(root))
+        free(root->string);
+
+    if (root->name && !json_test_shared(root))
+        free(root->name);
+    node_free(root);
+}
+
+void json_release(struct json_node *root)
+{
+    stats_start(start);
+
+    release_node(root);
+    stats_stop(release_ns, start);
+}
+
+static struct json_node *create_node(unsigned long flags)
+{
+    struct json_node *node;
+
+    node = node_alloc();
+    if (node)
+        node->flags = flags;
+
+    return node;
+}
+
+struct json_node *json_create_object(void)
+{
+    return create_node(JSON_IS_OBJECT);
+}
+
+struct json_node *json_create_array(void)
+{
+    return create_node(JSON_IS_ARRAY);
+}
+
+struct json_node *json_create_string(const char *string)
+{
+    struct json_node *node;
+    char *dup;
+
+    dup = strdup(string);
+    if (!dup)
+        return NULL;
+
+    node = create_node(JSON_IS_STRING);
+    if (!node) {
+        free(dup);
+        return NULL;
+    }
+
+    node->string = dup;
+    return node;
+}
+
+struct json_node *json_create_number(long number)
+{
+    struct json_node *node;
+
+    node = create_node(JSON_IS_NUMBER);
+    if (node)
+        node->number = number;
+
+    return node;
+}
+
+struct json_node *json_create_bool(bool value)
+{
+    return create_node(value ? JSON_IS_TRUE : JSON_IS_FALSE);
+}
+
+struct json_node *json_create_null(void)
+{
+    return create_node(JSON_IS_NULL);
+}
+
+static bool node_ancestor(struct json_node *node, struct json_node *parent)
+{
+    for (; parent; parent = parent->parent) {
+        if (parent == node)
+            return true;
+    }
+
+    return false;
+}
+
+static int link_name(struct json_node *parent, const char *name, struct json_node *node)
+{
+    char *dup = NULL;
+
+    if (!node)
+        return -ENOMEM;
+
+    if (!(json_test_array(parent) || json_test_object(parent)))
+        return -EINVAL;
+
+    /* linking a node under itself would make a cycle */
+    if (node->parent || node_ancestor(node, parent))
+        return -EBUSY;
+
+    if (json_test_object(parent)) {
+        if (!name && !node->name)
+            return -EINVAL;
+        if (!name)
+            return 0;
+        dup = strdup(name);
+        if (!dup)
+            return -ENOMEM;
     }
 
-    free(root);
+    if (node->name && !json_test_shared(node))
+        free(node->name);
+
+    json_clr_shared(node);
+    node->name = dup;
+    return 0;
+}
+
+int json_append(struct json_node *parent, const char *name, struct json_node *node)
+{
+    int retval;
+
+    retval = link_name(parent, name, node);
+    if (retval)
+        return retval;
+
+    list_add_prev(&parent->child, &node->sibling);
+    node->parent = parent;
+
+    return 0;
+}
+
+int json_insert(struct json_node *next, const char *name, struct json_node *node)
+{
+    int retval;
+
+    if (!next->parent)
+        return -EINVAL;
+
+    retval = link_name(next->parent, name, node);
+    if (retval)
+        return retval;
+
+    list_add_prev(&next->sibling, &node->sibling);
+    node->parent = next->parent;
+
+    return 0;
+}
+
+void json_detach(struct json_node *node)
+{
+    if (!node->parent)
+        return;
+
+    list_del(&node->sibling);
+    node->parent = NULL;
+}
+
+void json_remove(struct json_node *node)
+{
+    json_detach(node);
+    json_release(node);
 }
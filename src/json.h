@@ -9,6 +9,9 @@
 #include "list.h"
 #include "macro.h"
 #include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
 
 enum json_flags {
     __JSON_IS_ARRAY     = 0,
@@ -18,6 +21,8 @@ enum json_flags {
     __JSON_IS_NULL      = 4,
     __JSON_IS_TRUE      = 5,
     __JSON_IS_FALSE     = 6,
+    __JSON_IS_SHARED    = 7,
+    __JSON_IS_BORROWED  = 8,
 };
 
 #define JSON_IS_ARRAY   (1UL << __JSON_IS_ARRAY)
@@ -27,6 +32,8 @@ enum json_flags {
 #define JSON_IS_NULL    (1UL << __JSON_IS_NULL)
 #define JSON_IS_TRUE    (1UL << __JSON_IS_TRUE)
 #define JSON_IS_FALSE   (1UL << __JSON_IS_FALSE)
+#define JSON_IS_SHARED  (1UL << __JSON_IS_SHARED)
+#define JSON_IS_BORROWED (1UL << __JSON_IS_BORROWED)
 
 struct json_node {
     struct json_node *parent;
@@ -63,9 +70,368 @@ GENERIC_JSON_BITOPS(number, JSON_IS_NUMBER)
 GENERIC_JSON_BITOPS(null, JSON_IS_NULL)
 GENERIC_JSON_BITOPS(true, JSON_IS_TRUE)
 GENERIC_JSON_BITOPS(false, JSON_IS_FALSE)
+GENERIC_JSON_BITOPS(shared, JSON_IS_SHARED)
+GENERIC_JSON_BITOPS(borrowed, JSON_IS_BORROWED)
 
+/*
+ * Interning tables are not locked: share one between parses
+ * on the same thread, or give each thread its own table.
+ * Interned names stay valid until the table is destroyed.
+ */
+struct json_intern;
+
+/*
+ * Duplicate object keys are appended by default. The other policies
+ * check each member in constant time against the keys already parsed:
+ * FIRST keeps the earliest member, LAST the latest and ERROR fails the
+ * parse with -EEXIST.
+ */
+enum json_dupkey {
+    JSON_DUPKEY_APPEND  = 0,
+    JSON_DUPKEY_FIRST   = 1,
+    JSON_DUPKEY_LAST    = 2,
+    JSON_DUPKEY_ERROR   = 3,
+};
+
+/* SORTED orders object members by name, COMPACT drops all whitespace */
+enum json_encode_flags {
+    JSON_ENCODE_SORTED  = 1U << 0,
+    JSON_ENCODE_COMPACT = 1U << 1,
+};
+
+struct json_option {
+    struct json_intern *intern;
+    enum json_dupkey dupkey;
+    unsigned int encode;
+};
+
+extern struct json_intern *json_intern_create(void);
+extern void json_intern_destroy(struct json_intern *intern);
+extern const char *json_intern(struct json_intern *intern, const char *name);
+extern const char *json_intern_lookup(struct json_intern *intern, const char *name);
+extern unsigned int json_intern_count(struct json_intern *intern);
+extern size_t json_intern_memory(struct json_intern *intern);
+
+#define JSON_STATS_TYPES    7
+#define JSON_STATS_MASK     ((1UL << JSON_STATS_TYPES) - 1)
+
+/*
+ * Counters filled in by the calling thread's parse, encode and release
+ * calls while attached. Only built with CONFIG_JSON_STATS, otherwise
+ * attaching is a no-op and the hooks compile away.
+ */
+struct json_stats {
+    unsigned long long parse_bytes;
+    unsigned long long encode_bytes;
+    unsigned long long nodes[JSON_STATS_TYPES + 1];
+    unsigned int max_depth;
+    unsigned long long tbuff_reallocs;
+    unsigned long long alloc_count;
+    unsigned long long alloc_bytes;
+    unsigned long long pool_hits;
+    unsigned long long parse_ns;
+    unsigned long long decode_ns;
+    unsigned long long encode_ns;
+    unsigned long long release_ns;
+};
+
+#ifdef CONFIG_JSON_STATS
+extern void json_stats_attach(struct json_stats *stats);
+#else
+static inline void json_stats_attach(struct json_stats *stats) {}
+#endif
+
+/*
+ * Incremental parsing: feed returns how many bytes it consumed, which is
+ * less than given once the top-level value closes, and done tells whether
+ * it has (a document may close on the last byte of a chunk). finish hands
+ * out the tree (also completing a bare top-level scalar) and resets the
+ * parser for the next document; on a document still open it returns
+ * -EAGAIN and keeps it, so feeding can go on. read pulls from a
+ * non-blocking fd and returns -EAGAIN until a document is complete,
+ * keeping unread bytes queued. parse is the one-shot form and follows
+ * the rules of json_parse().
+ */
+struct json_parser;
+
+extern struct json_parser *json_parser_create(const struct json_option *option);
+extern void json_parser_destroy(struct json_parser *parser);
+extern ssize_t json_parser_feed(struct json_parser *parser, const char *buff, size_t length);
+extern bool json_parser_done(struct json_parser *parser);
+extern int json_parser_finish(struct json_parser *parser, struct json_node **root);
+extern int json_parser_read(struct json_parser *parser, int fd, struct json_node **root);
+extern int json_parser_parse(struct json_parser *parser, const char *buff, struct json_node **root);
+
+/*
+ * A reusing parser keeps its own node pool and string arena: trees it
+ * returns borrow their names and strings from the arena, and handing a
+ * tree back with json_parser_recycle() makes its nodes available to the
+ * next parse. Once every tree has been recycled the arena rewinds, so
+ * parsing similar documents back to back stops allocating altogether.
+ * Trees must not outlive the parser and should go back through recycle,
+ * a tree passed to json_release() instead keeps the arena from rewinding.
+ * recycle on a reusing parser refuses with -EINVAL anything but a whole
+ * tree it handed out. Other parsers hand out ordinary trees, recycle then
+ * releases any whole tree like json_release() and refuses only subtrees.
+ */
+extern struct json_parser *json_parser_create_reuse(const struct json_option *option);
+extern int json_parser_recycle(struct json_parser *parser, struct json_node *root);
+
+/*
+ * Resumable encoding with the same text as json_encode(), less the NUL:
+ * fill copies as much as fits and returns 0 once everything was handed
+ * out, write sends to a non-blocking fd and returns -EAGAIN while the fd
+ * is full. The tree must stay unchanged until the writer is done.
+ */
+struct json_writer;
+
+extern struct json_writer *json_writer_create(struct json_node *root);
+extern void json_writer_destroy(struct json_writer *writer);
+extern int json_writer_fill(struct json_writer *writer, char *buff, int size);
+extern int json_writer_write(struct json_writer *writer, int fd);
+
+/*
+ * The one-shot parsers take a single NUL terminated document, anything but
+ * blanks after it is -EINVAL. Numbers are integers that fit a long, a
+ * fraction or exponent is -EINVAL and an out of range value -ERANGE.
+ */
+extern int json_parse_option(const char *buff, struct json_node **root, const struct json_option *option);
 extern int json_parse(const char *buff, struct json_node **root);
 extern int json_encode(struct json_node *root, char *buff, int size);
+extern int json_encode_option(struct json_node *root, char *buff, int size, const struct json_option *option);
 extern void json_release(struct json_node *root);
 
+extern size_t json_memory(struct json_node *root);
+
+extern int json_escape(char *buff, int size, const char *string);
+extern int json_unescape(char *string, size_t length);
+extern int json_utf8_check(const char *string, size_t length);
+
+extern struct json_node *json_create_object(void);
+extern struct json_node *json_create_array(void);
+extern struct json_node *json_create_string(const char *string);
+extern struct json_node *json_create_number(long number);
+extern struct json_node *json_create_bool(bool value);
+extern struct json_node *json_create_null(void);
+
+extern int json_append(struct json_node *parent, const char *name, struct json_node *node);
+extern int json_insert(struct json_node *next, const char *name, struct json_node *node);
+extern void json_detach(struct json_node *node);
+extern void json_remove(struct json_node *node);
+
+/*
+ * Released nodes are cached per thread, up to a fixed count, for the next
+ * parse or build on the same thread. A thread's cache is drained when the
+ * thread exits, call json_pool_drain() to hand it back to malloc earlier.
+ */
+extern void json_pool_drain(void);
+
+/*
+ * A frozen document takes ownership of a finished tree and hands it out
+ * read-only to any number of threads. References are counted atomically,
+ * the last put releases the tree. The key index used by lookups is built
+ * on first use and published with a single compare-and-swap, so readers
+ * never block. The tree must not be modified once frozen.
+ */
+struct json_frozen;
+
+extern struct json_frozen *json_freeze(struct json_node *root);
+extern struct json_frozen *json_frozen_get(struct json_frozen *frozen);
+extern void json_frozen_put(struct json_frozen *frozen);
+extern struct json_node *json_frozen_root(struct json_frozen *frozen);
+extern struct json_node *json_frozen_lookup(struct json_frozen *frozen, struct json_node *object, const char *name);
+
+enum json_ftype {
+    JSON_FTYPE_BOOL     = 0,
+    JSON_FTYPE_INT      = 1,
+    JSON_FTYPE_UINT     = 2,
+    JSON_FTYPE_STRING   = 3,
+    JSON_FTYPE_BUFFER   = 4,
+    JSON_FTYPE_OBJECT   = 5,
+};
+
+/*
+ * Schemas map object keys straight onto struct members so hot message
+ * types skip the node tree. INT and UINT take their width from the
+ * member and refuse fractions and exponents as json_parse() does, though
+ * a 64-bit UINT takes its full range. STRING members own a heap copy
+ * (null decodes to NULL) and BUFFER members are fixed char arrays. Key
+ * hashes are computed once by json_schema_prepare(), which must run
+ * before a schema is shared between threads. Unknown keys are skipped
+ * but must still be valid JSON, missing keys leave the member untouched,
+ * so decode into a zeroed struct and hand it to json_struct_release()
+ * when done, also after a failed decode.
+ */
+struct json_schema;
+
+struct json_field {
+    const char *name;
+    enum json_ftype type;
+    size_t offset;
+    size_t size;
+    struct json_schema *schema;
+    unsigned long long hash;
+};
+
+struct json_schema {
+    struct json_field *fields;
+    unsigned int count;
+    size_t size;
+    bool prepared;
+};
+
+#define JSON_FIELD_NAMED(key, stype, member, ftype) {               \
+    .name = key, .type = ftype, .offset = offsetof(stype, member),  \
+    .size = sizeof(((stype *)0)->member),                           \
+}
+
+#define JSON_FIELD(stype, member, ftype)                            \
+    JSON_FIELD_NAMED(#member, stype, member, ftype)
+
+#define JSON_FIELD_STRUCT(stype, member, sub) {                     \
+    .name = #member, .type = JSON_FTYPE_OBJECT,                     \
+    .offset = offsetof(stype, member),                              \
+    .size = sizeof(((stype *)0)->member), .schema = &sub,           \
+}
+
+#define JSON_SCHEMA(name, stype, ...)                               \
+struct json_schema name = {                                         \
+    .fields = (struct json_field []) { __VA_ARGS__ },               \
+    .count = ARRAY_SIZE(((struct json_field []) { __VA_ARGS__ })),  \
+    .size = sizeof(stype),                                          \
+}
+
+extern void json_schema_prepare(struct json_schema *schema);
+extern int json_struct_decode(struct json_schema *schema, const char *buff, void *object);
+extern int json_struct_encode(struct json_schema *schema, const void *object, char *buff, int size);
+extern void json_struct_release(struct json_schema *schema, void *object);
+
+enum json_ctype {
+    JSON_CTYPE_NULL     = 0,
+    JSON_CTYPE_TRUE     = 1,
+    JSON_CTYPE_FALSE    = 2,
+    JSON_CTYPE_NUMBER   = 3,
+    JSON_CTYPE_STRING   = 4,
+    JSON_CTYPE_ARRAY    = 5,
+    JSON_CTYPE_OBJECT   = 6,
+    JSON_CTYPE_KEY      = 7,
+};
+
+#define JSON_CENTRY_TYPE        0x0fU
+#define JSON_CENTRY_INLINE      0x10U
+#define JSON_CENTRY_NAMED       0x20U
+#define JSON_CENTRY_INLINE_MAX  8
+
+/*
+ * Read-only tree packed into 16-byte entries in pre-order. Links are
+ * entry indexes, 0 meaning none (the root always sits at index 0).
+ * Object members are a KEY entry immediately followed by the value,
+ * which carries JSON_CENTRY_NAMED. Strings shorter than 8 bytes live
+ * inline, longer ones in the shared string pool.
+ */
+struct json_centry {
+    uint32_t info;
+    uint32_t next;
+    union {
+        int64_t number;
+        char text[JSON_CENTRY_INLINE_MAX];
+        struct {
+            uint32_t offset;
+            uint32_t length;
+        } str;
+        struct {
+            uint32_t child;
+            uint32_t count;
+        } con;
+    };
+};
+
+#define JSON_BINARY_MAGIC       "LJSB"
+#define JSON_BINARY_VERSION     1
+#define JSON_BINARY_ORDER       0x0102
+
+/*
+ * Binary image: this header, then the entries, then the string pool,
+ * all in host byte order so a mapped file is read in place.
+ */
+struct json_binary_header {
+    char magic[4];
+    uint16_t version;
+    uint16_t order;
+    uint32_t count;
+    uint32_t pool_size;
+};
+
+enum json_compact_flags {
+    JSON_COMPACT_BORROWED   = 1U << 0,
+    JSON_COMPACT_MAPPED     = 1U << 1,
+};
+
+struct json_compact {
+    struct json_centry *entries;
+    char *pool;
+    uint32_t count;
+    uint32_t pool_size;
+    unsigned int flags;
+    void *image;
+    size_t image_size;
+};
+
+static inline enum json_ctype json_compact_type(const struct json_compact *compact, uint32_t index)
+{
+    return compact->entries[index].info & JSON_CENTRY_TYPE;
+}
+
+static inline uint32_t json_compact_first(const struct json_compact *compact, uint32_t index)
+{
+    return compact->entries[index].con.child;
+}
+
+static inline uint32_t json_compact_next(const struct json_compact *compact, uint32_t index)
+{
+    return compact->entries[index].next;
+}
+
+static inline uint32_t json_compact_count(const struct json_compact *compact, uint32_t index)
+{
+    return compact->entries[index].con.count;
+}
+
+static inline int64_t json_compact_number(const struct json_compact *compact, uint32_t index)
+{
+    return compact->entries[index].number;
+}
+
+static inline const char *json_compact_text(const struct json_compact *compact, uint32_t index)
+{
+    const struct json_centry *entry = &compact->entries[index];
+
+    if (entry->info & JSON_CENTRY_INLINE)
+        return entry->text;
+
+    return compact->pool + entry->str.offset;
+}
+
+static inline const char *json_compact_name(const struct json_compact *compact, uint32_t index)
+{
+    if (!(compact->entries[index].info & JSON_CENTRY_NAMED))
+        return NULL;
+
+    return json_compact_text(compact, index - 1);
+}
+
+#define json_compact_for_each(compact, parent, index) \
+    for (index = json_compact_first(compact, parent); index; \
+         index = json_compact_next(compact, index))
+
+extern int json_compact_build(struct json_compact *compact, struct json_node *root);
+extern void json_compact_release(struct json_compact *compact);
+extern size_t json_compact_memory(struct json_compact *compact);
+extern int json_compact_expand(const struct json_compact *compact, uint32_t index, struct json_node **root);
+
+extern size_t json_compact_save(const struct json_compact *compact, void *buff, size_t size);
+extern int json_compact_load(struct json_compact *compact, const void *image, size_t size);
+extern int json_compact_dump(const struct json_compact *compact, const char *path);
+extern int json_compact_open(struct json_compact *compact, const char *path);
+
 #endif  /* _JSON_H_ */
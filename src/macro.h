@@ -10,6 +10,13 @@
     sizeof(arr) / sizeof((arr)[0]) \
 )
 
+#define min(a, b) ({ \
+    typeof(a) _amin = (a); \
+    typeof(a) _bmin = (b); \
+    (void)(&_amin == &_bmin); \
+    _amin < _bmin ? _amin : _bmin; \
+})
+
 #define max(a, b) ({ \
     typeof(a) _amax = (a); \
     typeof(a) _bmax = (b); \
@@ -0,0 +1,582 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2022 Sanpe <sanpeqf@gmail.com>
+ */
+
+#include "json.h"
+#include "hash.h"
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define SCHEMA_KEY_MAX      64
+#define SCHEMA_DEPTH_MAX    32
+
+struct schema_string {
+    const char *start;
+    size_t length;
+    bool escaped;
+};
+
+void json_schema_prepare(struct json_schema *schema)
+{
+    struct json_field *field;
+    unsigned int count;
+
+    if (schema->prepared)
+        return;
+
+    for (count = 0; count < schema->count; ++count) {
+        field = &schema->fields[count];
+        field->hash = hash_string(field->name, strlen(field->name));
+        if (field->type == JSON_FTYPE_OBJECT)
+            json_schema_prepare(field->schema);
+    }
+
+    schema->prepared = true;
+}
+
+static inline const char *skip_space(const char *walk)
+{
+    while (*walk == ' ' || *walk == '\t' || *walk == '\n' || *walk == '\r')
+        walk++;
+    return walk;
+}
+
+static const char *scan_string(const char *walk, struct schema_string *string)
+{
+    string->start = ++walk;
+    string->escaped = false;
+
+    for (; *walk != '"'; ++walk) {
+        if ((unsigned char)*walk < 0x20)
+            return NULL;
+        if (*walk == '\\') {
+            string->escaped = true;
+            if (!*++walk)
+                return NULL;
+        }
+    }
+
+    string->length = walk - string->start;
+    return walk + 1;
+}
+
+/* copy out and decode a scanned string, @size includes the terminator */
+static int copy_string(char *buff, size_t size, const struct schema_string *string)
+{
+    int retval;
+
+    if (string->length >= size && !string->escaped)
+        return -ENOSPC;
+
+    if (string->length < size) {
+        memcpy(buff, string->start, string->length);
+        buff[string->length] = '\0';
+        retval = string->escaped ? json_unescape(buff, string->length) : (int)string->length;
+    } else {
+        /* escapes only shrink, decode aside and see whether it fits */
+        char *temp = malloc(string->length + 1);
+        if (!temp)
+            return -ENOMEM;
+        memcpy(temp, string->start, string->length);
+        retval = json_unescape(temp, string->length);
+        if (retval >= 0 && (size_t)retval >= size)
+            retval = -ENOSPC;
+        if (retval >= 0)
+            memcpy(buff, temp, retval + 1);
+        free(temp);
+    }
+
+    if (retval < 0)
+        return retval;
+
+    return json_utf8_check(buff, retval);
+}
+
+/* integers only, as in trees: -?(0|[1-9][0-9]*) up to the next delimiter */
+static const char *scan_number(const char *walk, bool *negative,
+                               unsigned long long *value, bool *overflow)
+{
+    unsigned long long result = 0;
+
+    *overflow = false;
+    *negative = *walk == '-';
+    if (*negative)
+        walk++;
+
+    if (*walk == '0')
+        walk++;
+    else if ('1' <= *walk && *walk <= '9') {
+        for (; '0' <= *walk && *walk <= '9'; ++walk) {
+            if (result > (ULLONG_MAX - (*walk - '0')) / 10)
+                *overflow = true;
+            result = result * 10 + (*walk - '0');
+        }
+    } else
+        return NULL;
+
+    /* a fraction, an exponent or anything else glued on is refused */
+    if (*walk && !strchr(" \t\n\r,]}", *walk))
+        return NULL;
+
+    *value = result;
+    return walk;
+}
+
+/* the range of a tree's number, skipped values follow json_parse() */
+static inline bool number_fits(bool negative, unsigned long long value, bool overflow)
+{
+    return !overflow && value <= (unsigned long long)LLONG_MAX + negative;
+}
+
+/* skipped strings and keys are checked the way json_parse() would */
+static int check_string(const struct schema_string *string)
+{
+    char stack[SCHEMA_KEY_MAX], *buff = stack;
+    int retval;
+
+    if (!string->escaped)
+        return json_utf8_check(string->start, string->length);
+
+    if (string->length >= sizeof(stack)) {
+        buff = malloc(string->length + 1);
+        if (!buff)
+            return -ENOMEM;
+    }
+
+    retval = copy_string(buff, string->length + 1, string);
+    if (buff != stack)
+        free(buff);
+
+    return retval;
+}
+
+static const char *skip_value(const char *walk, unsigned int depth, int *retval)
+{
+    struct schema_string string;
+    unsigned long long number;
+    bool negative, overflow;
+    char close;
+
+    walk = skip_space(walk);
+    switch (*walk) {
+        case '"':
+            if (!(walk = scan_string(walk, &string)))
+                break;
+            *retval = check_string(&string);
+            return *retval ? NULL : walk;
+
+        case '[': case '{':
+            if (depth >= SCHEMA_DEPTH_MAX) {
+                *retval = -EOVERFLOW;
+                return NULL;
+            }
+            close = *walk == '[' ? ']' : '}';
+            walk = skip_space(walk + 1);
+            if (*walk == close)
+                return walk + 1;
+            for (;;) {
+                if (close == '}') {
+                    if (*walk != '"' || !(walk = scan_string(walk, &string)))
+                        break;
+                    *retval = check_string(&string);
+                    if (*retval)
+                        return NULL;
+                    walk = skip_space(walk);
+                    if (*walk++ != ':')
+                        break;
+                }
+                if (!(walk = skip_value(walk, depth + 1, retval)))
+                    return NULL;
+                walk = skip_space(walk);
+                if (*walk == close)
+                    return walk + 1;
+                if (*walk++ != ',')
+                    break;
+                walk = skip_space(walk);
+            }
+            break;
+
+        case 't':
+            if (!strncmp(walk, "true", 4))
+                return walk + 4;
+            break;
+
+        case 'f':
+            if (!strncmp(walk, "false", 5))
+                return walk + 5;
+            break;
+
+        case 'n':
+            if (!strncmp(walk, "null", 4))
+                return walk + 4;
+            break;
+
+        default:
+            if (!(walk = scan_number(walk, &negative, &number, &overflow)))
+                break;
+            if (!number_fits(negative, number, overflow)) {
+                *retval = -ERANGE;
+                return NULL;
+            }
+            return walk;
+    }
+
+    *retval = -EINVAL;
+    return NULL;
+}
+
+static int store_int(const struct json_field *field, void *member, long long value)
+{
+    switch (field->size) {
+        case 1:
+            if (value < INT8_MIN || value > INT8_MAX)
+                return -ERANGE;
+            *(int8_t *)member = value;
+            return 0;
+
+        case 2:
+            if (value < INT16_MIN || value > INT16_MAX)
+                return -ERANGE;
+            *(int16_t *)member = value;
+            return 0;
+
+        case 4:
+            if (value < INT32_MIN || value > INT32_MAX)
+                return -ERANGE;
+            *(int32_t *)member = value;
+            return 0;
+
+        case 8:
+            *(int64_t *)member = value;
+            return 0;
+
+        default:
+            return -EINVAL;
+    }
+}
+
+static int store_uint(const struct json_field *field, void *member, unsigned long long value)
+{
+    switch (field->size) {
+        case 1:
+            if (value > UINT8_MAX)
+                return -ERANGE;
+            *(uint8_t *)member = value;
+            return 0;
+
+        case 2:
+            if (value > UINT16_MAX)
+                return -ERANGE;
+            *(uint16_t *)member = value;
+            return 0;
+
+        case 4:
+            if (value > UINT32_MAX)
+                return -ERANGE;
+            *(uint32_t *)member = value;
+            return 0;
+
+        case 8:
+            *(uint64_t *)member = value;
+            return 0;
+
+        default:
+            return -EINVAL;
+    }
+}
+
+static int find_field(struct json_schema *schema, const struct schema_string *key,
+                      const struct json_field **field)
+{
+    char stack[SCHEMA_KEY_MAX], *buff = stack;
+    unsigned long long hash;
+    const char *name = key->start;
+    size_t length = key->length;
+    unsigned int count;
+    int retval;
+
+    *field = NULL;
+    if (key->escaped) {
+        if (length >= sizeof(stack)) {
+            buff = malloc(length + 1);
+            if (!buff)
+                return -ENOMEM;
+        }
+        retval = copy_string(buff, length + 1, key);
+        if (retval)
+            goto finish;
+        name = buff;
+        length = strlen(buff);
+    } else {
+        retval = json_utf8_check(name, length);
+        if (retval)
+            goto finish;
+    }
+
+    hash = hash_string(name, length);
+    for (count = 0; count < schema->count; ++count) {
+        if (schema->fields[count].hash == hash &&
+            !strncmp(schema->fields[count].name, name, length) &&
+            !schema->fields[count].name[length]) {
+            *field = &schema->fields[count];
+            break;
+        }
+    }
+
+finish:
+    if (buff != stack)
+        free(buff);
+    return retval;
+}
+
+static const char *decode_object(struct json_schema *schema, const char *walk,
+                                 void *object, unsigned int depth, int *retval);
+
+static const char *decode_field(const struct json_field *field, const char *walk,
+                                void *object, unsigned int depth, int *retval)
+{
+    void *member = (char *)object + field->offset;
+    struct schema_string string;
+    unsigned long long number;
+    bool negative, overflow;
+    char *copy;
+
+    walk = skip_space(walk);
+    switch (field->type) {
+        case JSON_FTYPE_BOOL:
+            if (!strncmp(walk, "true", 4)) {
+                *(bool *)member = true;
+                return walk + 4;
+            } else if (!strncmp(walk, "false", 5)) {
+                *(bool *)member = false;
+                return walk + 5;
+            }
+            break;
+
+        case JSON_FTYPE_INT:
+            if (!(walk = scan_number(walk, &negative, &number, &overflow)))
+                break;
+            if (!number_fits(negative, number, overflow))
+                *retval = -ERANGE;
+            else
+                *retval = store_int(field, member, negative ? (long long)(0ULL - number) : (long long)number);
+            return *retval ? NULL : walk;
+
+        case JSON_FTYPE_UINT:
+            if (!(walk = scan_number(walk, &negative, &number, &overflow)))
+                break;
+            /* "-0" is still zero, any other sign is out of range */
+            if (overflow || (negative && number))
+                *retval = -ERANGE;
+            else
+                *retval = store_uint(field, member, number);
+            return *retval ? NULL : walk;
+
+        case JSON_FTYPE_STRING:
+            if (!strncmp(walk, "null", 4)) {
+                free(*(char **)member);
+                *(char **)member = NULL;
+                return walk + 4;
+            }
+            if (*walk != '"' || !(walk = scan_string(walk, &string)))
+                break;
+            copy = malloc(string.length + 1);
+            if (!copy) {
+                *retval = -ENOMEM;
+                return NULL;
+            }
+            *retval = copy_string(copy, string.length + 1, &string);
+            if (*retval) {
+                free(copy);
+                return NULL;
+            }
+            free(*(char **)member);
+            *(char **)member = copy;
+            return walk;
+
+        case JSON_FTYPE_BUFFER:
+            if (*walk != '"' || !(walk = scan_string(walk, &string)))
+                break;
+            *retval = copy_string(member, field->size, &string);
+            return *retval ? NULL : walk;
+
+        case JSON_FTYPE_OBJECT:
+            if (depth >= SCHEMA_DEPTH_MAX) {
+                *retval = -EOVERFLOW;
+                return NULL;
+            }
+            return decode_object(field->schema, walk, member, depth + 1, retval);
+    }
+
+    *retval = -EINVAL;
+    return NULL;
+}
+
+static const char *decode_object(struct json_schema *schema, const char *walk,
+                                 void *object, unsigned int depth, int *retval)
+{
+    const struct json_field *field;
+    struct schema_string key;
+
+    walk = skip_space(walk);
+    if (*walk != '{')
+        goto invalid;
+
+    walk = skip_space(walk + 1);
+    if (*walk == '}')
+        return walk + 1;
+
+    for (;;) {
+        if (*walk != '"' || !(walk = scan_string(walk, &key)))
+            goto invalid;
+        walk = skip_space(walk);
+        if (*walk++ != ':')
+            goto invalid;
+
+        *retval = find_field(schema, &key, &field);
+        if (*retval)
+            return NULL;
+
+        if (field)
+            walk = decode_field(field, walk, object, depth, retval);
+        else
+            walk = skip_value(walk, depth + 1, retval);
+        if (!walk)
+            return NULL;
+
+        walk = skip_space(walk);
+        if (*walk == '}')
+            return walk + 1;
+        if (*walk++ != ',')
+            goto invalid;
+        walk = skip_space(walk);
+    }
+
+invalid:
+    *retval = -EINVAL;
+    return NULL;
+}
+
+int json_struct_decode(struct json_schema *schema, const char *buff, void *object)
+{
+    int retval = 0;
+
+    json_schema_prepare(schema);
+
+    buff = decode_object(schema, buff, object, 0, &retval);
+    if (!buff)
+        return retval ? retval : -EINVAL;
+
+    return *skip_space(buff) ? -EINVAL : 0;
+}
+
+static int encode_object(struct json_schema *schema, const void *object, char *buff,
+                         int size, int len, unsigned int depth)
+{
+    #define json_sprintf(fmt, ...) len += snprintf(buff + len, max(0, size - len), fmt, ##__VA_ARGS__)
+    #define json_sescape(string) len += json_escape(buff + len, max(0, size - len), string)
+    const struct json_field *field;
+    const void *member;
+    unsigned int count, index;
+
+    json_sprintf("{\n");
+
+    for (count = 0; count < schema->count; ++count) {
+        field = &schema->fields[count];
+        member = (const char *)object + field->offset;
+
+        for (index = 0; index < depth + 1; ++index)
+            json_sprintf("\t");
+        json_sprintf("\"");
+        json_sescape(field->name);
+        json_sprintf("\": ");
+
+        switch (field->type) {
+            case JSON_FTYPE_BOOL:
+                json_sprintf("%s", *(const bool *)member ? "true" : "false");
+                break;
+
+            case JSON_FTYPE_INT:
+                switch (field->size) {
+                    case 1: json_sprintf("%d", *(const int8_t *)member); break;
+                    case 2: json_sprintf("%d", *(const int16_t *)member); break;
+                    case 4: json_sprintf("%d", *(const int32_t *)member); break;
+                    default: json_sprintf("%lld", (long long)*(const int64_t *)member); break;
+                }
+                break;
+
+            case JSON_FTYPE_UINT:
+                switch (field->size) {
+                    case 1: json_sprintf("%u", *(const uint8_t *)member); break;
+                    case 2: json_sprintf("%u", *(const uint16_t *)member); break;
+                    case 4: json_sprintf("%u", *(const uint32_t *)member); break;
+                    default: json_sprintf("%llu", (unsigned long long)*(const uint64_t *)member); break;
+                }
+                break;
+
+            case JSON_FTYPE_STRING:
+                if (!*(char *const *)member) {
+                    json_sprintf("null");
+                    break;
+                }
+                json_sprintf("\"");
+                json_sescape(*(char *const *)member);
+                json_sprintf("\"");
+                break;
+
+            case JSON_FTYPE_BUFFER:
+                json_sprintf("\"");
+                json_sescape(member);
+                json_sprintf("\"");
+                break;
+
+            case JSON_FTYPE_OBJECT:
+                len = encode_object(field->schema, member, buff, size, len, depth + 1);
+                break;
+        }
+
+        json_sprintf(",\n");
+    }
+
+    if (schema->count) {
+        len -= 2;
+        json_sprintf("\n");
+    }
+
+    for (index = 0; index < depth; ++index)
+        json_sprintf("\t");
+    json_sprintf("}");
+
+    return len;
+}
+
+int json_struct_encode(struct json_schema *schema, const void *object, char *buff, int size)
+{
+    int length;
+
+    length = encode_object(schema, object, buff, size, 0, 0);
+    length += snprintf(buff + length, max(0, size - length), "\n") + 1;
+
+    return length;
+}
+
+void json_struct_release(struct json_schema *schema, void *object)
+{
+    const struct json_field *field;
+    unsigned int count;
+    void *member;
+
+    for (count = 0; count < schema->count; ++count) {
+        field = &schema->fields[count];
+        member = (char *)object + field->offset;
+
+        if (field->type == JSON_FTYPE_STRING) {
+            free(*(char **)member);
+            *(char **)member = NULL;
+        } else if (field->type == JSON_FTYPE_OBJECT)
+            json_struct_release(field->schema, member);
+    }
+}
@@ -0,0 +1,57 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright(c) 2022 Sanpe <sanpeqf@gmail.com>
+ */
+
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include "json.h"
+
+#ifdef CONFIG_JSON_STATS
+#include <time.h>
+
+extern __thread struct json_stats *json_stats_current;
+
+static inline unsigned long long stats_clock(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static inline void stats_node(struct json_node *node)
+{
+    if (json_stats_current)
+        json_stats_current->nodes[__builtin_ctzl((node->flags & JSON_STATS_MASK) |
+                                  1UL << JSON_STATS_TYPES)]++;
+}
+
+# define stats_add(field, value) do {                   \
+    if (json_stats_current)                             \
+        json_stats_current->field += (value);           \
+} while (0)
+
+# define stats_max(field, value) do {                   \
+    if (json_stats_current &&                           \
+        json_stats_current->field < (value))            \
+        json_stats_current->field = (value);            \
+} while (0)
+
+# define stats_start(name) \
+    unsigned long long name = json_stats_current ? stats_clock() : 0
+
+# define stats_stop(field, name) \
+    stats_add(field, stats_clock() - (name))
+
+#else  /* !CONFIG_JSON_STATS */
+
+# define stats_node(node)           do { } while (0)
+# define stats_add(field, value)    do { } while (0)
+# define stats_max(field, value)    do { } while (0)
+# define stats_start(name)          do { } while (0)
+# define stats_stop(field, name)    do { } while (0)
+
+#endif  /* CONFIG_JSON_STATS */
+#endif  /* _STATS_H_ */